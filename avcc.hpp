@@ -0,0 +1,128 @@
+/**
+ * @file avcc.hpp
+ *
+ * Definition of ISO/IEC 14496-15 AVC decoder configuration record (avcC).
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _AVCC_HPP_
+#define _AVCC_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "h264_structure.hpp"
+#include "ioutilities.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+namespace h264
+{
+
+} /* end of namespace h264 */
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+namespace h264
+{
+
+/* ISO/IEC 14496-15, 5.3.3.1 AVCDecoderConfigurationRecord */
+struct avcc : public h264_structure
+{
+    struct nal_unit
+    {
+        const uint8_t* data; /* points into the record */
+        std::size_t size;
+    };
+
+    avcc() :
+        h264_structure()
+    {
+    }
+
+    std::string to_string() const override;
+
+    uint32_t configuration_version;
+    uint32_t avc_profile_indication;
+    uint32_t profile_compatibility;
+    uint32_t avc_level_indication;
+    uint32_t length_size_minus_one;
+    uint32_t num_of_sequence_parameter_sets;
+    uint32_t num_of_picture_parameter_sets;
+
+    std::vector<nal_unit> sequence_parameter_sets;
+    std::vector<nal_unit> picture_parameter_sets;
+};
+
+inline std::string avcc::to_string() const
+{
+    std::ostringstream stream;
+
+    stream << "avcc (avc decoder configuration record):" << std::endl;
+    stream << P1(configuration_version);
+    stream << P1(avc_profile_indication);
+    stream << P1(profile_compatibility);
+    stream << P1(avc_level_indication);
+    stream << P1(length_size_minus_one);
+    stream << P1(num_of_sequence_parameter_sets);
+    stream << P1(num_of_picture_parameter_sets);
+
+    return stream.str();
+}
+
+} /* end of namespace h264 */
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+namespace h264
+{
+
+} /* end of namespace h264 */
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+namespace h264
+{
+
+} /* end of namespace h264 */
+} /* end of namespace ymn */
+
+#endif /* _AVCC_HPP_ */
@@ -62,6 +62,8 @@ public:
 
     explicit base_parser(std::size_t capacity) :
         m_flatbuffer(capacity),
+        m_capacity(m_flatbuffer.capacity()),
+        m_max_capacity(m_capacity),
         m_user_data(nullptr)
     {
 #if defined(DEBUG)
@@ -93,6 +95,41 @@ public:
         m_flatbuffer.reset();
     }
 
+    /**
+     * Drops all the buffered data and releases storage enlarged
+     * beyond the initial capacity (see set_max_capacity()).
+     */
+    void shrink_buffer()
+    {
+        m_flatbuffer.shrink(m_capacity);
+    }
+
+    /**
+     * Lets the buffer grow up to given capacity, when data which cannot
+     * be dropped yet (e.g. incomplete NAL unit) fills it up. It grows
+     * only when needed, so streams not needing it keep the initial one.
+     * By default the buffer never grows.
+     */
+    void set_max_capacity(std::size_t max_capacity)
+    {
+        m_max_capacity = (max_capacity > m_capacity) ? max_capacity : m_capacity;
+    }
+
+    std::size_t get_max_capacity() const
+    {
+        return m_max_capacity;
+    }
+
+    void attach(const T data[], std::size_t count)
+    {
+        m_flatbuffer.attach(data, count);
+    }
+
+    std::size_t extend(std::size_t count)
+    {
+        return m_flatbuffer.extend(count);
+    }
+
     void set_user_data(void* user_data)
     {
         m_user_data = user_data;
@@ -105,9 +142,16 @@ public:
 
     std::size_t write(const T data[], std::size_t count)
     {
-        if (count > m_flatbuffer.write_available())
+        if (count > m_flatbuffer.write_available()) {
             m_flatbuffer.move();
 
+            /* retained data fills the whole buffer, let it grow (doubling) */
+            if ((0 == m_flatbuffer.write_available()) && (m_flatbuffer.capacity() < m_max_capacity)) {
+                std::size_t capacity = 2 * m_flatbuffer.capacity();
+                m_flatbuffer.grow((capacity < m_max_capacity) ? capacity : m_max_capacity);
+            }
+        }
+
         return m_flatbuffer.write(data, count);
     }
 
@@ -143,6 +187,8 @@ protected:
     flatbuffer<T> m_flatbuffer;
 
 private:
+    std::size_t m_capacity; /* initial one */
+    std::size_t m_max_capacity;
     void* m_user_data;
 };
 
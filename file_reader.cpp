@@ -0,0 +1,274 @@
+/**
+ * @file file_reader.cpp
+ *
+ * Asynchronous (double-buffered) file reader.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <iostream>
+
+#include <cstdlib>
+#include <cerrno>
+
+extern "C" {
+    #include <unistd.h>
+    #include <fcntl.h>
+}
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "file_reader.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+file_reader::file_reader(std::size_t block_size, std::size_t number_of_blocks, bool direct) :
+    m_fd(-1),
+    m_direct(direct),
+    m_failed(false),
+    m_valid(true),
+    m_block_size((block_size + FILE_READER_ALIGNMENT - 1) & ~(FILE_READER_ALIGNMENT - 1)),
+    m_offset(0),
+    m_blocks(number_of_blocks < 2 ? 2 : number_of_blocks),
+    m_mutex(),
+    m_cv(),
+    m_free(),
+    m_filled(),
+    m_eof(false),
+    m_stop(false),
+    m_thread()
+{
+    /* aligned_alloc() requires size to be a (non zero) multiple of the alignment */
+    if (0 == m_block_size)
+        m_block_size = FILE_READER_ALIGNMENT;
+
+    for (auto& b : m_blocks) {
+        /* O_DIRECT requires buffer, file offset and transfer size to be aligned */
+        b.data = static_cast<uint8_t*>(std::aligned_alloc(FILE_READER_ALIGNMENT, m_block_size));
+        b.size = 0;
+        b.offset = 0;
+        if (nullptr == b.data)
+            m_valid = false;
+    }
+
+    if (!m_valid)
+        std::cerr << "error: cannot allocate " << m_blocks.size() << " blocks of " << m_block_size << " bytes" << std::endl;
+}
+
+file_reader::~file_reader()
+{
+    close();
+
+    for (auto& b : m_blocks)
+        std::free(b.data);
+}
+
+bool file_reader::open(const char* filename)
+{
+    close();
+
+    if (!m_valid)
+        return false;
+
+    m_fd = ::open(filename, O_RDONLY | (m_direct ? O_DIRECT : 0));
+    if ((m_fd < 0) && m_direct && (EINVAL == errno)) {
+        /* filesystem does not support O_DIRECT */
+        std::cerr << "warning: O_DIRECT not supported for '" << filename << "', using buffered reads" << std::endl;
+        m_direct = false;
+        m_fd = ::open(filename, O_RDONLY);
+    }
+
+    if (m_fd < 0)
+        return false;
+
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    m_offset = 0;
+    m_failed = false;
+    m_eof = false;
+    m_stop = false;
+    m_free.clear();
+    m_filled.clear();
+    for (auto& b : m_blocks)
+        m_free.push_back(&b);
+
+    m_thread = std::thread(&file_reader::run, this);
+
+    return true;
+}
+
+void file_reader::close()
+{
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_fd = -1;
+}
+
+const file_reader::block* file_reader::acquire()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_cv.wait(lock, [this]{ return !m_filled.empty() || m_eof; });
+
+    if (m_filled.empty())
+        return nullptr;
+
+    block* b = m_filled.front();
+    m_filled.pop_front();
+
+    return b;
+}
+
+void file_reader::release(const block* b)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(const_cast<block*>(b));
+    }
+    m_cv.notify_all();
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+void file_reader::run()
+{
+    for (;;) {
+        block* b;
+        long n;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]{ return !m_free.empty() || m_stop; });
+            if (m_stop)
+                break;
+            b = m_free.front();
+            m_free.pop_front();
+        }
+
+        n = read_block(b);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (n > 0)
+                m_filled.push_back(b);
+            else
+                m_free.push_back(b);
+            /* short read means that end of file has been reached */
+            if (n < static_cast<long>(m_block_size))
+                m_eof = true;
+        }
+        m_cv.notify_all();
+
+        if (n < static_cast<long>(m_block_size))
+            break;
+    }
+}
+
+long file_reader::read_block(block* b)
+{
+    std::size_t count = 0;
+
+    b->offset = m_offset;
+
+    while (count < m_block_size) {
+        ssize_t n = ::read(m_fd, b->data + count, m_block_size - count);
+        if ((n < 0) && (EINTR == errno))
+            continue;
+
+        if ((n < 0) && m_direct && (EINVAL == errno) && (0 == count)) {
+            /* O_DIRECT was accepted by open() but not by read() */
+            fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+            m_direct = false;
+            continue;
+        }
+
+        if (n < 0) {
+            m_failed = true;
+            break;
+        }
+
+        if (0 == n)
+            break;
+
+        count += n;
+
+        /* with O_DIRECT only the final (partial) block may be shorter */
+        if (m_direct && (count & (FILE_READER_ALIGNMENT - 1)))
+            break;
+    }
+
+    b->size = count;
+    m_offset += count;
+
+    /* do not let cold, sequentially scanned data evict hot page cache */
+    if (!m_direct && (count > 0))
+        posix_fadvise(m_fd, b->offset, count, POSIX_FADV_DONTNEED);
+
+    return count;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
@@ -0,0 +1,190 @@
+/**
+ * @file file_reader.hpp
+ *
+ * Definition of asynchronous (double-buffered) file reader.
+ *
+ * Reader thread fills a pool of large, page aligned blocks with subsequent
+ * portions of a file and hands them over to the consumer via bounded queue,
+ * so that disk I/O overlaps with parsing of previously read data.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _FILE_READER_HPP_
+#define _FILE_READER_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define FILE_READER_ALIGNMENT            4096
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+class file_reader
+{
+public:
+    struct block
+    {
+        uint8_t* data;
+        std::size_t size;   /* number of valid bytes */
+        std::size_t offset; /* file offset of data[0] */
+    };
+
+    /**
+     * @param[in] block_size Size of a single read (rounded up to FILE_READER_ALIGNMENT,
+     *                       at least one FILE_READER_ALIGNMENT).
+     * @param[in] number_of_blocks Number of blocks in the pool (at least 2).
+     * @param[in] direct When true, file is opened with O_DIRECT (bypassing page cache).
+     *                   Otherwise pages already read are dropped from the page cache
+     *                   with posix_fadvise(POSIX_FADV_DONTNEED).
+     */
+    explicit file_reader(std::size_t block_size, std::size_t number_of_blocks, bool direct);
+    ~file_reader();
+
+    file_reader(const file_reader&) = delete;
+    file_reader(file_reader&&) = delete;
+    file_reader& operator = (const file_reader&) = delete;
+    file_reader& operator = (file_reader&&) = delete;
+
+    /**
+     * Opens the file and starts the reader thread.
+     *
+     * @return true on success, false otherwise (also when blocks
+     *         could not be allocated, see is_valid()).
+     */
+    bool open(const char* filename);
+
+    /**
+     * Stops the reader thread and closes the file.
+     */
+    void close();
+
+    /**
+     * Waits for the next filled block.
+     *
+     * @return Pointer to the block or nullptr when end of file has been reached.
+     *         Every acquired block shall be given back by release().
+     */
+    const block* acquire();
+
+    void release(const block* b);
+
+    bool is_valid() const
+    {
+        return m_valid;
+    }
+
+    bool is_direct() const
+    {
+        return m_direct;
+    }
+
+    bool has_failed() const
+    {
+        return m_failed;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "file_reader@";
+        stream << std::hex << this;
+        stream << " [fd: ";
+        stream << std::dec << m_fd;
+        stream << ", block_size: ";
+        stream << std::dec << m_block_size;
+        stream << ", blocks: ";
+        stream << std::dec << m_blocks.size();
+        stream << ", direct: ";
+        stream << (m_direct ? "y" : "n");
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    void run();
+    long read_block(block* b);
+
+    int m_fd;
+    bool m_direct;
+    bool m_failed;
+    bool m_valid; /* all blocks have been allocated */
+    std::size_t m_block_size;
+    std::size_t m_offset;
+
+    std::vector<block> m_blocks;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<block*> m_free;
+    std::deque<block*> m_filled;
+    bool m_eof;
+    bool m_stop;
+
+    std::thread m_thread;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _FILE_READER_HPP_ */
@@ -3,6 +3,14 @@
  *
  * Definition of generic flatbuffer design pattern.
  *
+ * Where possible (Linux) the storage is mapped twice, one copy right after
+ * the other, so that data wrapping around the end of the storage is still
+ * seen as contiguous. Making room for new data (move()) then only shifts
+ * the view, data once written never moves. Otherwise (or if mapping fails)
+ * the storage is an ordinary array and move() compacts it with memmove().
+ * The storage can be enlarged (grow()) for data not fitting the capacity
+ * the flatbuffer was created with.
+ *
  * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
  *
  * This program is free software; you can redistribute it and/or modify it
@@ -25,6 +33,12 @@
 #include <sstream>
 
 #include <cstring>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #if defined(DEBUG_FLATBUFFER)
 #include <iostream>
@@ -59,15 +73,23 @@ namespace ymn
 template<typename T>
 class flatbuffer
 {
+    static_assert(std::is_trivially_copyable<T>::value, "flatbuffer elements are copied with memcpy()");
+
 public:
     typedef T value_type;
 
     explicit flatbuffer(std::size_t capacity) :
         m_capacity(capacity),
         m_counters(capacity),
-        m_buffer(nullptr)
+        m_storage(nullptr),
+        m_buffer(nullptr),
+        m_mirrored(false),
+        m_attached(false)
     {
-        m_buffer = new T[m_capacity];
+        m_storage = allocate_storage(m_capacity, m_mirrored);
+
+        m_counters.reset(m_capacity);
+        m_buffer = m_storage;
 
 #if defined(DEBUG_FLATBUFFER)
         std::cout << __PRETTY_FUNCTION__ << std::endl;
@@ -81,7 +103,7 @@ public:
         std::cout << __PRETTY_FUNCTION__ << std::endl;
 #endif
 
-        delete [] m_buffer;
+        release_storage(m_storage, m_capacity, m_mirrored);
     }
 
     flatbuffer(const flatbuffer&) = delete;
@@ -94,6 +116,19 @@ public:
         return (m_capacity > 0) && (m_buffer != nullptr);
     }
 
+    bool is_attached() const
+    {
+        return m_attached;
+    }
+
+    /**
+     * @return true if making room for new data does not copy it (see move()).
+     */
+    bool is_mirrored() const
+    {
+        return m_mirrored;
+    }
+
     std::size_t capacity() const
     {
         return m_capacity;
@@ -142,13 +177,65 @@ public:
 
     void reset()
     {
+        m_buffer = m_storage;
+        m_attached = false;
         m_counters.reset(m_capacity);
     }
 
+    /**
+     * Turns the flatbuffer into a read-only view of externally owned memory
+     * (e.g. memory mapped file), so that data does not need to be copied
+     * by write() before it can be parsed.
+     *
+     * While attached, write() does not accept any data.
+     * Call reset() to return to the flatbuffer's own storage.
+     *
+     * @param[in] data  Pointer to the first element of the view.
+     * @param[in] count Number of elements initially visible in the view.
+     */
+    void attach(const T data[], std::size_t count)
+    {
+        m_buffer = const_cast<T*>(data);
+        m_attached = true;
+        m_counters.reset(0);
+
+        m_counters.m_write_idx  = count;
+        m_counters.m_read_avail = count;
+    }
+
+    /**
+     * Makes next 'count' elements, which follow the attached view,
+     * available for reading. Caller is responsible for the memory
+     * beyond the current view to be valid.
+     *
+     * @param[in] count Number of elements to be appended to the view.
+     *
+     * @return Number of elements appended (0 if flatbuffer is not attached).
+     */
+    std::size_t extend(std::size_t count)
+    {
+        if (!is_attached())
+            return 0;
+
+        m_counters.m_write_idx  += count;
+        m_counters.m_read_avail += count;
+
+        return count;
+    }
+
+    /**
+     * Drops elements preceding the bookmark (or read position if bookmark
+     * is not set), so that whole capacity but the retained elements
+     * is available for writing. Pointers to retained elements remain valid
+     * if the storage is mirrored.
+     */
     void move()
     {
         std::size_t x;
 
+        if (is_attached())
+            return;
+
         if (m_counters.m_bookmark_idx >= 0) {
             x = m_counters.m_bookmark_idx;
             m_counters.m_bookmark_idx = 0;
@@ -160,7 +247,14 @@ public:
             std::size_t available_elements = m_counters.m_write_idx - x;
             std::size_t offset = m_counters.m_read_idx - x;
 
-            std::memmove(m_buffer, &m_buffer[x], available_elements * sizeof(T));
+            if (m_mirrored) {
+                /* the view just starts further, wrapping around to the first copy */
+                m_buffer += x;
+                if (m_buffer >= m_storage + m_capacity)
+                    m_buffer -= m_capacity;
+            }
+            else
+                std::memmove(m_buffer, &m_buffer[x], available_elements * sizeof(T));
 
             m_counters.m_read_idx = offset;
             m_counters.m_write_idx = available_elements;
@@ -168,6 +262,73 @@ public:
         }
     }
 
+    /**
+     * Replaces the storage with a bigger one, e.g. when the retained
+     * elements (see move()) already fill the whole capacity. Retained
+     * elements are copied once, pointers to them become invalid.
+     *
+     * @param[in] capacity Requested capacity (may be rounded up).
+     *
+     * @return true on success, false if flatbuffer is attached
+     *         or capacity is not bigger than the current one.
+     */
+    bool grow(std::size_t capacity)
+    {
+        std::size_t x;
+        bool mirrored;
+
+        if (is_attached() || (capacity <= m_capacity))
+            return false;
+
+        x = (m_counters.m_bookmark_idx >= 0) ? m_counters.m_bookmark_idx : m_counters.m_read_idx;
+
+        T* storage = allocate_storage(capacity, mirrored);
+        std::size_t available_elements = m_counters.m_write_idx - x;
+        memcpy(storage, &m_buffer[x], available_elements * sizeof(T));
+
+        release_storage(m_storage, m_capacity, m_mirrored);
+        m_storage = storage;
+        m_buffer = storage;
+        m_capacity = capacity;
+        m_mirrored = mirrored;
+
+        if (m_counters.m_bookmark_idx >= 0)
+            m_counters.m_bookmark_idx = 0;
+        m_counters.m_read_idx -= x;
+        m_counters.m_write_idx = available_elements;
+        m_counters.m_write_avail = m_capacity - available_elements;
+
+        return true;
+    }
+
+    /**
+     * Drops all the elements (see reset()) and returns to the storage
+     * of given capacity, if the current one is bigger (see grow()).
+     */
+    void shrink(std::size_t capacity)
+    {
+        bool mirrored;
+
+        reset();
+
+        if (capacity >= m_capacity)
+            return;
+
+        T* storage = allocate_storage(capacity, mirrored);
+        if (capacity >= m_capacity) {
+            /* rounded up to what we already have */
+            release_storage(storage, capacity, mirrored);
+            return;
+        }
+
+        release_storage(m_storage, m_capacity, m_mirrored);
+        m_storage = storage;
+        m_buffer = storage;
+        m_capacity = capacity;
+        m_mirrored = mirrored;
+        m_counters.reset(m_capacity);
+    }
+
     std::size_t write(const T data[], std::size_t count)
     {
         if (count > m_counters.m_write_avail)
@@ -266,9 +427,84 @@ private:
         long m_bookmark_idx; /* -1 when not set */
     };
 
+    /* mirrored storage if possible, capacity is updated accordingly */
+    static T* allocate_storage(std::size_t& capacity, bool& mirrored)
+    {
+        T* storage = map_mirrored_storage(capacity);
+
+        mirrored = (storage != nullptr);
+        if (!mirrored)
+            storage = new T[capacity];
+
+        return storage;
+    }
+
+    static void release_storage(T* storage, std::size_t capacity, bool mirrored)
+    {
+        if (mirrored)
+            unmap_mirrored_storage(storage, capacity);
+        else
+            delete [] storage;
+    }
+
+    /* rounds capacity up to whole pages and maps them twice (Linux only) */
+    static T* map_mirrored_storage(std::size_t& capacity)
+    {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        const long page_size = sysconf(_SC_PAGESIZE);
+
+        if ((capacity == 0) || (page_size <= 0) || (page_size % sizeof(T)))
+            return nullptr;
+
+        const std::size_t size = ((capacity * sizeof(T) + page_size - 1) / page_size) * page_size;
+
+        const int fd = memfd_create("flatbuffer", MFD_CLOEXEC);
+        if (fd < 0)
+            return nullptr;
+
+        T* storage = nullptr;
+        void* p;
+
+        do {
+            if (ftruncate(fd, size) != 0)
+                break;
+
+            /* reserve address space for both copies, then put the copies in it */
+            p = mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                break;
+
+            if ((mmap(p, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+                (mmap(static_cast<uint8_t*>(p) + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+                munmap(p, 2 * size);
+                break;
+            }
+
+            storage = static_cast<T*>(p);
+            capacity = size / sizeof(T);
+        } while (0);
+
+        close(fd);
+
+        return storage;
+#else
+        return nullptr;
+#endif
+    }
+
+    static void unmap_mirrored_storage(T* storage, std::size_t capacity)
+    {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        munmap(storage, 2 * capacity * sizeof(T));
+#endif
+    }
+
     std::size_t m_capacity;
     counters m_counters;
-    T* m_buffer;
+    T* m_storage;
+    T* m_buffer; /* view of m_storage or attached external memory */
+    bool m_mirrored;
+    bool m_attached;
 };
 
 } /* end of namespace ymn */
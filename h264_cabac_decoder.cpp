@@ -1280,15 +1280,12 @@ void h264_cabac_decoder::init_context_variables(const h264::slice_header& slice_
 
 void h264_cabac_decoder::init_decoding_engine(const h264::slice_data& slice_data)
 {
+    m_stream = rbsp_istream(slice_data.data, slice_data.size, slice_data.zero_bytes);
+
     if (slice_data.bit_pos > 0)
     {
-        /* realign and init stream */
-        m_stream = istream(slice_data.data + 1, slice_data.size - 1);
-    }
-    else
-    {
-        /* init stream (it's already aligned) */
-        m_stream = istream(slice_data.data, slice_data.size);
+        /* realign stream */
+        m_stream.skip_bits(BITS_PER_BYTE);
     }
 
     m_codIRange = 0x1FE; // 510
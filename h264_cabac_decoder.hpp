@@ -29,7 +29,7 @@
 \*===========================================================================*/
 #include "slice_header.hpp"
 #include "slice_data.hpp"
-#include "istream.hpp"
+#include "rbsp_istream.hpp"
 
 /*===========================================================================*\
  * preprocessor #define constants and macros
@@ -74,7 +74,7 @@ private:
        int valMPS;
     };
 
-    istream_be m_stream;
+    rbsp_istream m_stream;
     uint32_t m_codIRange;
     uint32_t m_codIOffset;
 
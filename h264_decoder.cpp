@@ -18,6 +18,10 @@
 /*===========================================================================*\
  * system header files
 \*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <iomanip>
+
 #include <cstdint>
 
 /*===========================================================================*\
@@ -75,8 +79,11 @@ h264_decoder::h264_decoder(h264_parser_container_e container) :
     m_dimensions{},
     m_active_sps{nullptr},
     m_active_pps{nullptr},
-    m_picture{nullptr}
+    m_picture{nullptr},
+    m_first_pts{H264_PARSER_NO_TIMESTAMP},
+    m_start_time{0}
 {
+    m_parser.set_max_capacity(H264_DECODER_MAX_BUFFER_SIZE);
 }
 
 h264_decoder::~h264_decoder()
@@ -90,6 +97,8 @@ void h264_decoder::feed(const uint8_t* data, std::size_t count)
     do {
         n_written = m_parser.write(data, count);
         if (0 == n_written) {
+            m_parser.get_ostream() << "NAL unit exceeds " << m_parser.get_max_capacity()
+                << " bytes buffer, dropped" << std::endl;
             m_parser.reset();
             continue;
         }
@@ -107,6 +116,80 @@ void h264_decoder::feed(const uint8_t* data, std::size_t count)
     } while (count > 0);
 }
 
+void h264_decoder::reset()
+{
+    m_parser.clear();
+    m_active_sps = nullptr;
+    m_active_pps = nullptr;
+    m_first_pts = H264_PARSER_NO_TIMESTAMP;
+}
+
+void h264_decoder::attach(const uint8_t* data, std::size_t count)
+{
+    m_parser.attach(data, count);
+    parse();
+}
+
+void h264_decoder::extend(std::size_t count)
+{
+    m_parser.extend(count);
+    parse();
+}
+
+void h264_decoder::feed_nal_unit(const uint8_t* data, std::size_t count)
+{
+    process(m_parser.parse_nal_unit(data, count));
+}
+
+void h264_decoder::flush()
+{
+    h264_parser_status_e status = m_parser.flush();
+
+    if (status != h264_parser_status_e::NEED_BYTES)
+        process(status);
+}
+
+void h264_decoder::discard()
+{
+    m_parser.reset();
+}
+
+bool h264_decoder::configure(const uint8_t* record, std::size_t size)
+{
+    h264::avcc avcc;
+
+    if (!h264_parse_avc_decoder_configuration_record(record, size, avcc) ||
+        !m_parser.set_nal_length_size(avcc.length_size_minus_one + 1)) {
+        m_parser.get_ostream() << "avcc (avc decoder configuration record) is malformed" << std::endl;
+        return false;
+    }
+
+    m_parser.get_ostream() << avcc.to_string();
+
+    for (const auto& nal_unit : avcc.sequence_parameter_sets)
+        feed_nal_unit(nal_unit.data, nal_unit.size);
+
+    for (const auto& nal_unit : avcc.picture_parameter_sets)
+        feed_nal_unit(nal_unit.data, nal_unit.size);
+
+    return true;
+}
+
+/* hh:mm:ss.mmm */
+std::string ymn::h264_decoder_time_to_string(uint64_t time)
+{
+    std::ostringstream stream;
+    const uint64_t ms = time / (H264_DECODER_TIMESTAMP_CLOCK / 1000);
+
+    stream << std::setfill('0');
+    stream << std::setw(2) << ms / 3600000 << ":";
+    stream << std::setw(2) << ms / 60000 % 60 << ":";
+    stream << std::setw(2) << ms / 1000 % 60 << ".";
+    stream << std::setw(3) << ms % 1000;
+
+    return stream.str();
+}
+
 /*===========================================================================*\
  * protected function definitions
 \*===========================================================================*/
@@ -264,6 +347,16 @@ void h264_decoder::decode_slice(const h264::slice_header& sh, const h264::slice_
 {
     bool sps_changed = false;
     bool pps_changed = false;
+    const uint64_t pts = m_parser.get_pts();
+    uint64_t time = 0;
+
+    if (pts != H264_PARSER_NO_TIMESTAMP) {
+        if (H264_PARSER_NO_TIMESTAMP == m_first_pts)
+            m_first_pts = pts;
+        time = (pts - m_first_pts) & H264_DECODER_TIMESTAMP_MASK;
+        if (time < m_start_time)
+            return;
+    }
 
     const h264::pps* active_pps = sh.get_active_pps();
 
@@ -290,7 +383,7 @@ void h264_decoder::decode_slice(const h264::slice_header& sh, const h264::slice_
     if (sps_changed) {
         /* active sps has changed, so reinit dimensions */
         m_dimensions.reset(*m_active_sps);
-        std::cout << std::endl << m_dimensions.to_string();
+        m_parser.get_ostream() << std::endl << m_dimensions.to_string();
     }
 
     if (pps_changed) {
@@ -310,6 +403,13 @@ void h264_decoder::decode_slice(const h264::slice_header& sh, const h264::slice_
           or CAVLC, see subclause 9.2).
         - Otherwise (entropy_coding_mode_flag is equal to 1), the method specified by
           the right descriptor in the syntax table is applied (CABAC, see subclause 9.3). */
+        if ((pts != H264_PARSER_NO_TIMESTAMP) && (0 == sh.first_mb_in_slice)) {
+            m_parser.get_ostream() << "picture pts: " << pts;
+            if (m_parser.get_dts() != pts)
+                m_parser.get_ostream() << " dts: " << m_parser.get_dts();
+            m_parser.get_ostream() << " time: " << h264_decoder_time_to_string(time) << std::endl;
+        }
+
         if (m_active_pps->entropy_coding_mode_flag)
             m_picture = new h264::picture_cabac(*this, sh);
         else
@@ -327,118 +427,128 @@ void h264_decoder::parse()
 
     do {
         status = m_parser.parse();
+        process(status);
+    } while (status != h264_parser_status_e::NEED_BYTES);
+}
 
-        switch (status) {
-            case h264_parser_status_e::NAL_UNIT_SKIPPED:
-                break;
-
-            case h264_parser_status_e::NAL_UNIT_CORRUPTED:
-                break;
-
-            case h264_parser_status_e::AUD_PARSED:
-            {
-                const h264_structure* aud;
-
-                aud = m_parser.get_structure(
-                    h264_parser_structure_e::AUD,
-                    H264_PARSER_STRUCTURE_ID_RECENT);
-
-                if (aud)
-                    std::cout << aud->to_string();
-                else
-                    std::cout << "Parser returned '" << ymn::to_string(status) <<
-                        "' but associated structure cannot be retrived" << std::endl;
-                break;
-            }
-
-            case h264_parser_status_e::SPS_PARSED:
-            {
-                const h264_structure* sps;
-
-                sps = m_parser.get_structure(
-                    h264_parser_structure_e::SPS,
-                    H264_PARSER_STRUCTURE_ID_RECENT);
-
-                if (sps)
-                    std::cout << sps->to_string();
-                else
-                    std::cout << "Parser returned '" << ymn::to_string(status) <<
-                        "' but associated structure cannot be retrived" << std::endl;
-                break;
-            }
-
-            case h264_parser_status_e::PPS_PARSED:
-            {
-                const h264_structure* pps;
-
-                pps = m_parser.get_structure(
-                    h264_parser_structure_e::PPS,
-                    H264_PARSER_STRUCTURE_ID_RECENT);
-
-                if (pps)
-                    std::cout << pps->to_string();
-                else
-                    std::cout << "Parser returned '" << ymn::to_string(status) <<
-                        "' but associated structure cannot be retrived" << std::endl;
-                break;
-            }
+void h264_decoder::process(h264_parser_status_e status)
+{
+    switch (status) {
+        case h264_parser_status_e::NAL_UNIT_SKIPPED:
+            break;
+
+        case h264_parser_status_e::SLICE_SKIPPED:
+            /* picture is not decoded, but the time of pictures
+               is still counted from the first one of the stream */
+            if (H264_PARSER_NO_TIMESTAMP == m_first_pts)
+                m_first_pts = m_parser.get_pts();
+            break;
+
+        case h264_parser_status_e::NAL_UNIT_CORRUPTED:
+            break;
+
+        case h264_parser_status_e::AUD_PARSED:
+        {
+            const h264_structure* aud;
+
+            aud = m_parser.get_structure(
+                h264_parser_structure_e::AUD,
+                H264_PARSER_STRUCTURE_ID_RECENT);
+
+            if (aud)
+                m_parser.get_ostream() << aud->to_string();
+            else
+                m_parser.get_ostream() << "Parser returned '" << ymn::to_string(status) <<
+                    "' but associated structure cannot be retrived" << std::endl;
+            break;
+        }
 
-            case h264_parser_status_e::SEI_PARSED:
-            {
-                const h264_structure* sei;
+        case h264_parser_status_e::SPS_PARSED:
+        {
+            const h264_structure* sps;
 
-                sei = m_parser.get_structure(
-                    h264_parser_structure_e::SEI,
-                    H264_PARSER_STRUCTURE_ID_RECENT);
+            sps = m_parser.get_structure(
+                h264_parser_structure_e::SPS,
+                H264_PARSER_STRUCTURE_ID_RECENT);
 
-                if (sei)
-                    std::cout << sei->to_string();
-                else
-                    std::cout << "Parser returned '" << ymn::to_string(status) <<
-                        "' but associated structure cannot be retrived" << std::endl;
-                break;
-            }
+            if (sps)
+                m_parser.get_ostream() << sps->to_string();
+            else
+                m_parser.get_ostream() << "Parser returned '" << ymn::to_string(status) <<
+                    "' but associated structure cannot be retrived" << std::endl;
+            break;
+        }
 
-            case h264_parser_status_e::SLICE_PARSED:
-            {
-                const h264_structure* slice_header;
+        case h264_parser_status_e::PPS_PARSED:
+        {
+            const h264_structure* pps;
 
-                slice_header = m_parser.get_structure(
-                    h264_parser_structure_e::SLICE_HEADER,
-                    H264_PARSER_STRUCTURE_ID_RECENT);
+            pps = m_parser.get_structure(
+                h264_parser_structure_e::PPS,
+                H264_PARSER_STRUCTURE_ID_RECENT);
 
-                if (slice_header)
-                    std::cout << slice_header->to_string();
-                else
-                    std::cout << "Parser returned '" << ymn::to_string(status) <<
-                        "' but associated structure cannot be retrived" << std::endl;
+            if (pps)
+                m_parser.get_ostream() << pps->to_string();
+            else
+                m_parser.get_ostream() << "Parser returned '" << ymn::to_string(status) <<
+                    "' but associated structure cannot be retrived" << std::endl;
+            break;
+        }
 
-                const h264_structure* slice_data;
+        case h264_parser_status_e::SEI_PARSED:
+        {
+            const h264_structure* sei;
 
-                slice_data = m_parser.get_structure(
-                    h264_parser_structure_e::SLICE_DATA,
-                    H264_PARSER_STRUCTURE_ID_RECENT);
+            sei = m_parser.get_structure(
+                h264_parser_structure_e::SEI,
+                H264_PARSER_STRUCTURE_ID_RECENT);
 
-                if (slice_data)
-                    std::cout << slice_data->to_string();
-                else
-                    std::cout << "Parser returned '" << ymn::to_string(status) <<
-                        "' but associated structure cannot be retrived" << std::endl;
+            if (sei)
+                m_parser.get_ostream() << sei->to_string();
+            else
+                m_parser.get_ostream() << "Parser returned '" << ymn::to_string(status) <<
+                    "' but associated structure cannot be retrived" << std::endl;
+            break;
+        }
 
-                if (slice_header && slice_data)
-                    decode_slice(
-                        *reinterpret_cast<const h264::slice_header*>(slice_header),
-                        *reinterpret_cast<const h264::slice_data*>(slice_data));
-                break;
-            }
+        case h264_parser_status_e::SLICE_PARSED:
+        {
+            const h264_structure* slice_header;
+
+            slice_header = m_parser.get_structure(
+                h264_parser_structure_e::SLICE_HEADER,
+                H264_PARSER_STRUCTURE_ID_RECENT);
+
+            if (slice_header)
+                m_parser.get_ostream() << slice_header->to_string();
+            else
+                m_parser.get_ostream() << "Parser returned '" << ymn::to_string(status) <<
+                    "' but associated structure cannot be retrived" << std::endl;
+
+            const h264_structure* slice_data;
+
+            slice_data = m_parser.get_structure(
+                h264_parser_structure_e::SLICE_DATA,
+                H264_PARSER_STRUCTURE_ID_RECENT);
+
+            if (slice_data)
+                m_parser.get_ostream() << slice_data->to_string();
+            else
+                m_parser.get_ostream() << "Parser returned '" << ymn::to_string(status) <<
+                    "' but associated structure cannot be retrived" << std::endl;
+
+            if (slice_header && slice_data)
+                decode_slice(
+                    *reinterpret_cast<const h264::slice_header*>(slice_header),
+                    *reinterpret_cast<const h264::slice_data*>(slice_data));
+            break;
+        }
 
-            default:
-                break;
-       }
-    } while (status != h264_parser_status_e::NEED_BYTES);
+        default:
+            break;
+    }
 }
 
 /*===========================================================================*\
  * local function definitions
 \*===========================================================================*/
-
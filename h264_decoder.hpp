@@ -42,6 +42,11 @@
 \*===========================================================================*/
 #define H264_QP_MAX (51 + 2 * 6) // The maximum supported qp
 
+/* timestamps are expected in 90 kHz units and to wrap around after 33 bits (as in MPEG2 systems) */
+#define H264_DECODER_TIMESTAMP_CLOCK    90000
+#define H264_DECODER_TIMESTAMP_MASK     ((UINT64_C(1) << 33) - 1)
+#define H264_DECODER_MAX_BUFFER_SIZE    (64 * 1024 * 1024)
+
 /*===========================================================================*\
  * inline function definitions
 \*===========================================================================*/
@@ -68,6 +73,131 @@ public:
 
     void feed(const uint8_t* data, std::size_t count);
 
+    /**
+     * Forgets everything parsed and decoded so far, so that the decoder
+     * can be reused for another (unrelated) stream.
+     */
+    void reset();
+
+    /**
+     * Parses data directly from externally owned memory (no copying).
+     *
+     * @param[in] data  Pointer to the beginning of h264 stream.
+     * @param[in] count Number of bytes initially available.
+     */
+    void attach(const uint8_t* data, std::size_t count);
+
+    /**
+     * Makes next 'count' bytes (following previously attached/extended ones)
+     * available to the parser and parses them.
+     */
+    void extend(std::size_t count);
+
+    /**
+     * Decodes one complete NAL unit (without start code prefix),
+     * e.g. depacketized from RTP or read from length-prefixed container.
+     */
+    void feed_nal_unit(const uint8_t* data, std::size_t count);
+
+    /**
+     * Decodes whatever is still pending in the parser (last NAL unit
+     * of annex b byte stream) and drops the rest. To be called at the end
+     * of the stream or of a self-contained part of it.
+     */
+    void flush();
+
+    /**
+     * Drops whatever is pending in the parser (e.g. NAL unit known
+     * to be damaged) without decoding it. Data fed by feed() only.
+     */
+    void discard();
+
+    /**
+     * Tells that data fed next (e.g. payload of a PES packet) carries
+     * given timestamps (see h264_parser::set_timestamps()).
+     * Decoded pictures are labelled with their presentation time.
+     */
+    void set_timestamps(uint64_t pts, uint64_t dts)
+    {
+        m_parser.set_timestamps(pts, dts);
+    }
+
+    /**
+     * Decodes only pictures presented at or after given time, counted
+     * from the time origin (see set_time_origin()).
+     * Slices before that time are parsed, but not decoded.
+     * Streams without timestamps are not affected.
+     *
+     * @param[in] start_time Time in H264_DECODER_TIMESTAMP_CLOCK units.
+     */
+    void set_start_time(uint64_t start_time)
+    {
+        m_start_time = start_time;
+    }
+
+    /**
+     * Drops P, B and SP slices before their headers are parsed
+     * (see h264_parser::set_intra_only()). Such slices are not decoded
+     * anyway, so it only saves the work spent on them.
+     */
+    void set_intra_only(bool intra_only)
+    {
+        m_parser.set_intra_only(intra_only);
+    }
+
+    /**
+     * Sets how big the parser's buffer may grow to hold a NAL unit fed
+     * by feed() (by default H264_DECODER_MAX_BUFFER_SIZE). It starts
+     * much smaller and grows only for NAL units not fitting it.
+     * NAL units bigger than that are dropped.
+     */
+    void set_max_buffer_size(std::size_t size)
+    {
+        m_parser.set_max_capacity(size);
+    }
+
+    /**
+     * Sets presentation timestamp the time of pictures is counted from
+     * (e.g. of the first picture of the file, when decoding starts
+     * somewhere in its middle). By default it is taken from the first slice.
+     */
+    void set_time_origin(uint64_t pts)
+    {
+        m_first_pts = pts;
+    }
+
+    /**
+     * Sets size of the NAL unit length field (AVCC container only).
+     *
+     * @return true on success, false if size is not 1, 2 or 4.
+     */
+    bool set_nal_length_size(uint32_t nal_length_size)
+    {
+        return m_parser.set_nal_length_size(nal_length_size);
+    }
+
+    /**
+     * Configures decoder from AVCDecoderConfigurationRecord (avcC),
+     * i.e. takes NAL unit length size from it and decodes
+     * sequence and picture parameter sets it carries.
+     *
+     * @return true on success, false if record is malformed.
+     */
+    bool configure(const uint8_t* record, std::size_t size);
+
+    /**
+     * Redirects decoder's log from std::cout to the given stream.
+     */
+    void set_ostream(std::ostream& ostream)
+    {
+        m_parser.set_ostream(ostream);
+    }
+
+    std::ostream& get_ostream() const
+    {
+        return m_parser.get_ostream();
+    }
+
     std::string to_string() const
     {
         std::ostringstream stream;
@@ -99,6 +229,7 @@ private:
     void decode_slice(const h264::slice_header& sh, const h264::slice_data& sd);
 
     void parse();
+    void process(h264_parser_status_e status);
 
 private:
     h264_parser m_parser;
@@ -109,6 +240,9 @@ private:
 
     h264::picture *m_picture;
 
+    uint64_t m_first_pts;
+    uint64_t m_start_time;
+
     /* dequantisation tables */
     int m_dequant4x4_buffer[SL_4x4_NUM][H264_QP_MAX + 1][16];
     int m_dequant8x8_buffer[SL_8x8_NUM][H264_QP_MAX + 1][64];
@@ -136,6 +270,11 @@ namespace ymn
 namespace ymn
 {
 
+/**
+ * Formats time (in H264_DECODER_TIMESTAMP_CLOCK units) as hh:mm:ss.mmm.
+ */
+std::string h264_decoder_time_to_string(uint64_t time);
+
 } /* end of namespace ymn */
 
 #endif /* _H264_DECODER_HPP_ */
@@ -18,11 +18,19 @@
 /*===========================================================================*\
  * system header files
 \*===========================================================================*/
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*===========================================================================*\
  * project header files
 \*===========================================================================*/
 #include "h264_parser.hpp"
+#include "rbsp_istream.hpp"
 #include "nal_unit_type.hpp"
 #include "ilog2.hpp"
 #include "inverse_scanning_tables.hpp"
@@ -35,6 +43,12 @@ using namespace ymn;
 /*===========================================================================*\
  * preprocessor #define constants and macros
 \*===========================================================================*/
+/* number of stream positions examined at once when looking for start codes */
+#if defined(__AVX2__)
+#define H264_PARSER_SCAN_LANES 32
+#else
+#define H264_PARSER_SCAN_LANES 16
+#endif
 
 /*===========================================================================*\
  * local type definitions
@@ -51,8 +65,6 @@ namespace
 /*===========================================================================*\
  * local function declarations
 \*===========================================================================*/
-static int h264_parser_nal_to_rbsp(
-    uint8_t* rbsp_buf, std::size_t rbsp_size, const uint8_t* nal_buf, std::size_t nal_size);
 
 /*===========================================================================*\
  * local object definitions
@@ -61,6 +73,56 @@ static int h264_parser_nal_to_rbsp(
 /*===========================================================================*\
  * inline function definitions
 \*===========================================================================*/
+/* bit n is set if both p[n] and p[n + 1] are zero (n < H264_PARSER_SCAN_LANES) */
+static inline uint32_t h264_parser_zero_pair_mask(const uint8_t* p)
+{
+#if defined(__AVX2__)
+    const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(v0, v1), _mm256_setzero_si256())));
+#elif defined(__SSE2__)
+    const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v0, v1), _mm_setzero_si128())));
+#else
+    uint32_t mask = 0;
+    for (std::size_t n = 0; n < H264_PARSER_SCAN_LANES; ++n)
+        mask |= static_cast<uint32_t>((p[n] | p[n + 1]) == 0x00) << n;
+    return mask;
+#endif
+}
+
+/*
+ * Finds first position i (i <= limit) of 0x000001 (or of any of 0x000000
+ * and 0x000001 when next_start_code_or_zero is set), so p[limit + 2]
+ * is the last byte which is looked at.
+ * Returns limit + 1 if there is no such position.
+ */
+static inline std::size_t h264_parser_find_start_code(const uint8_t* p, std::size_t limit, bool next_start_code_or_zero)
+{
+    const uint8_t third = next_start_code_or_zero ? 0x01 : 0x00;
+    std::size_t i = 0;
+
+    /* zero byte pairs are rare in NAL units (emulation prevention),
+       so most of the blocks are skipped after one comparison */
+    for (; i + H264_PARSER_SCAN_LANES <= limit; i += H264_PARSER_SCAN_LANES) {
+        uint32_t mask = h264_parser_zero_pair_mask(p + i);
+
+        while (mask) {
+            const std::size_t n = i + __builtin_ctz(mask);
+            if ((p[n + 2] == 0x01) || (p[n + 2] < third))
+                return n;
+            mask &= mask - 1;
+        }
+    }
+
+    for (; i <= limit; ++i)
+        if ((p[i] == 0x00) && (p[i + 1] == 0x00) && ((p[i + 2] == 0x01) || (p[i + 2] < third)))
+            return i;
+
+    return limit + 1;
+}
+
 template<std::size_t N>
 static inline void parse_scaling_list(istream_be& s, uint8_t (&coeffs)[N], const uint8_t (&dsl)[N])
 {
@@ -132,6 +194,223 @@ const h264_structure* h264_parser::get_structure(h264_parser_structure_e structu
     return retval && retval->is_valid() ? retval : nullptr;
 }
 
+h264_parser_status_e h264_parser::flush()
+{
+    h264_parser_status_e status = h264_parser_status_e::NEED_BYTES;
+    const uint8_t* s = m_flatbuffer.get_bookmark();
+
+    if (s && (m_parse_function == &h264_parser::parse_byte_stream_nal_units)) {
+        const uint8_t* e = m_flatbuffer.read_ptr() + m_flatbuffer.read_available();
+
+        /* trailing_zero_8bits do not belong to the NAL unit */
+        while ((e > s) && (0x00 == e[-1]))
+            e--;
+
+        if (e > s) {
+            update_timestamps(s);
+            status = parse_nal_unit(s, e - s);
+        }
+    }
+
+    reset();
+
+    return status;
+}
+
+h264_parser_status_e h264_parser::parse_nal_unit(const uint8_t* nal_unit, std::size_t size)
+{
+    h264_parser_status_e status;
+    std::size_t prefix_size;
+    int rbsp_size;
+    bool parsable;
+
+    if (0 == size)
+        return h264_parser_status_e::NAL_UNIT_CORRUPTED;
+
+    const uint32_t nal_unit_type = nal_unit[0] & 0x1f;
+
+    m_nal_unit = nal_unit;
+    m_nal_unit_size = size;
+
+    *m_ostream << std::endl;
+    *m_ostream << "nal_unit_type: " << nal_unit_type;
+    *m_ostream << " '" << ymn::to_string(static_cast<nal_unit_type_e>(nal_unit_type)) << "'";
+    *m_ostream << " size: " << size;
+    *m_ostream << std::endl;
+
+    /* slices of IDR pictures are always I or SI ones */
+    if (m_intra_only &&
+        (nal_unit_type == static_cast<uint32_t>(nal_unit_type_e::CODED_SLICE_NON_IDR_PICTURE)) &&
+        !is_intra_slice(nal_unit, size, parsable))
+        return parsable ? h264_parser_status_e::SLICE_SKIPPED : h264_parser_status_e::NAL_UNIT_SKIPPED;
+
+    /* slice data is not converted, it is read directly from the NAL unit */
+    prefix_size = size;
+    if ((nal_unit_type == static_cast<uint32_t>(nal_unit_type_e::CODED_SLICE_NON_IDR_PICTURE)) ||
+        (nal_unit_type == static_cast<uint32_t>(nal_unit_type_e::CODED_SLICE_IDR_PICTURE)))
+        prefix_size = std::min(size, static_cast<std::size_t>(H264_PARSER_SLICE_HEADER_PREFIX_SIZE));
+
+    if (m_rbsp.size() < prefix_size + H264_PARSER_RBSP_PADDING)
+        m_rbsp.resize(prefix_size + H264_PARSER_RBSP_PADDING);
+
+    rbsp_size = h264_parser_nal_to_rbsp(m_rbsp.data(), prefix_size, nal_unit, prefix_size);
+    if (rbsp_size <= 0)
+        return h264_parser_status_e::NAL_UNIT_CORRUPTED;
+
+    memset(m_rbsp.data() + rbsp_size, 0, H264_PARSER_RBSP_PADDING);
+
+    istream_be s(m_rbsp.data(), rbsp_size);
+    status = parse_nal_unit(s);
+
+    if ((s.status() & ISTREAM_STATUS_EOS_REACHED) && (prefix_size < size)) {
+        /* slice header does not fit in the prefix, whole NAL unit is needed */
+        if (m_rbsp.size() < size + H264_PARSER_RBSP_PADDING)
+            m_rbsp.resize(size + H264_PARSER_RBSP_PADDING);
+
+        rbsp_size = h264_parser_nal_to_rbsp(m_rbsp.data(), size, nal_unit, size);
+        if (rbsp_size <= 0)
+            return h264_parser_status_e::NAL_UNIT_CORRUPTED;
+
+        memset(m_rbsp.data() + rbsp_size, 0, H264_PARSER_RBSP_PADDING);
+
+        istream_be whole(m_rbsp.data(), rbsp_size);
+        status = parse_nal_unit(whole);
+    }
+
+    return status;
+}
+
+int ymn::h264_parser_nal_to_rbsp(
+    uint8_t* rbsp_buf, std::size_t rbsp_size, const uint8_t* nal_buf, std::size_t nal_size)
+{
+    std::size_t i   = 0;        /* position 0x0000 is looked for from */
+    std::size_t run = 0;        /* first byte not copied yet */
+    std::size_t end = nal_size; /* bytes from here on are not copied */
+    std::size_t j   = 0;
+    std::size_t k;
+
+    while (i + 1 < nal_size) {
+        /* 0x0000 is rare, bytes between such pairs are copied in bulk */
+        if (i + H264_PARSER_SCAN_LANES < nal_size) {
+            const uint32_t mask = h264_parser_zero_pair_mask(nal_buf + i);
+            if (0 == mask) {
+                i += H264_PARSER_SCAN_LANES;
+                continue;
+            }
+            k = i + __builtin_ctz(mask);
+        }
+        else {
+            if ((nal_buf[i] != 0x00) || (nal_buf[i + 1] != 0x00)) {
+                i++;
+                continue;
+            }
+            k = i;
+        }
+
+        if (k + 2 >= nal_size)
+            break;
+
+        /* within the NAL unit, the following three-byte sequences shall not occur */
+        /* at any byte-aligned position: 0x000000, 0x000001, 0x000002 */
+        if (nal_buf[k + 2] < 0x03)
+            return -1;
+
+        if (nal_buf[k + 2] > 0x03) {
+            i = k + 1;
+            continue;
+        }
+
+        /* if cabac_zero_word is used, the final byte of this NAL unit(0x03) is discarded, */
+        /* and the last two bytes of RBSP must be 0x0000 */
+        if (k + 3 == nal_size) {
+            end = k + 2;
+            break;
+        }
+
+        /* within the NAL unit, any four-byte sequence that starts with 0x000003 */
+        /* other than the following sequences shall not occur at any byte-aligned position: */
+        /* 0x00000300, 0x00000301, 0x00000302, 0x00000303 */
+        if (nal_buf[k + 3] > 0x03)
+            return -1;
+
+        /* copy everything up to emulation_prevention_three_byte */
+        if (j + (k + 2 - run) > rbsp_size)
+            return -1; /* error, not enough space */
+        memcpy(rbsp_buf + j, nal_buf + run, k + 2 - run);
+        j += k + 2 - run;
+
+        run = k + 3;
+        i = k + 3;
+    }
+
+    if (j + (end - run) > rbsp_size)
+        return -1; /* error, not enough space */
+    memcpy(rbsp_buf + j, nal_buf + run, end - run);
+    j += end - run;
+
+    return j;
+}
+
+bool ymn::h264_parse_avc_decoder_configuration_record(const uint8_t* record, std::size_t size, h264::avcc& avcc)
+{
+    const uint8_t* p = record;
+    const uint8_t* end = record + size;
+    std::vector<h264::avcc::nal_unit>* lists[] = {&avcc.sequence_parameter_sets, &avcc.picture_parameter_sets};
+    uint32_t counts[2];
+
+    avcc.reset();
+    avcc.sequence_parameter_sets.clear();
+    avcc.picture_parameter_sets.clear();
+
+    if (size < 6)
+        return false;
+
+    avcc.configuration_version          = p[0];
+    avcc.avc_profile_indication         = p[1];
+    avcc.profile_compatibility          = p[2];
+    avcc.avc_level_indication           = p[3];
+    avcc.length_size_minus_one          = p[4] & 0x03;
+    avcc.num_of_sequence_parameter_sets = p[5] & 0x1f;
+    p += 6;
+
+    if (1 != avcc.configuration_version)
+        return false;
+
+    counts[0] = avcc.num_of_sequence_parameter_sets;
+    counts[1] = 0;
+
+    for (int l = 0; l < 2; ++l) {
+        if (1 == l) {
+            if (p >= end)
+                return false;
+            avcc.num_of_picture_parameter_sets = counts[1] = *p++;
+        }
+
+        for (uint32_t i = 0; i < counts[l]; ++i) {
+            std::size_t length;
+
+            if (end - p < 2)
+                return false;
+            length = (p[0] << 8) | p[1];
+            p += 2;
+            if (static_cast<std::size_t>(end - p) < length)
+                return false;
+
+            lists[l]->push_back({p, length});
+            p += length;
+        }
+    }
+
+    /* remaining bytes (chroma_format etc. for high profiles) are not needed here */
+
+    if (2 == avcc.length_size_minus_one)
+        return false; /* 3 byte length field is not allowed */
+
+    avcc.set_valid(true);
+
+    return true;
+}
+
 /*===========================================================================*\
  * protected function definitions
 \*===========================================================================*/
@@ -151,9 +430,7 @@ bool h264_parser::find_next_start_code()
     limit = available - 3;
 
     p = m_flatbuffer.read_ptr();
-    i = 0;
-    while ((i <= limit) && (p[i] != 0x00 || p[i + 1] != 0x00 || p[i + 2] != 0x01))
-        i++;
+    i = h264_parser_find_start_code(p, limit, false);
 
     if (i > limit)
         return false; /* have not found start of a nal unit */
@@ -188,9 +465,7 @@ int h264_parser::find_nal_unit()
     limit = available - 3;
 
     p = m_flatbuffer.read_ptr();
-    i = 0;
-    while ((i <= limit) && ((p[i] != 0x00) || (p[i + 1] != 0x00) || (p[i + 2] > 0x01)))
-        i++;
+    i = h264_parser_find_start_code(p, limit, true);
 
     m_flatbuffer.consume(i);
 
@@ -327,8 +602,8 @@ bool h264_parser::parse_hrd_parameters(istream_be& s, h264::hrd_parameters& hrd)
     bool retval = false;
 
     do {
-        if (!CHK_EXPR(s.read_exp_golomb_u(hrd.cpb_cnt_minus1), std::cout) ||
-            !CHK_STRUCT_RANGE(hrd, cpb_cnt_minus1, 0U, 31U, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(hrd.cpb_cnt_minus1), *m_ostream) ||
+            !CHK_STRUCT_RANGE(hrd, cpb_cnt_minus1, 0U, 31U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -616,8 +891,8 @@ h264_parser_status_e h264_parser::parse_aud(istream_be& s)
         h264::aud& aud = m_aud;
         aud.reset();
 
-        if (!CHK_EXPR(s.read_bits(3, aud.primary_pic_type), std::cout) ||
-            !CHK_STRUCT_RANGE(aud, primary_pic_type, 0U, 7U, std::cout)) {
+        if (!CHK_EXPR(s.read_bits(3, aud.primary_pic_type), *m_ostream) ||
+            !CHK_STRUCT_RANGE(aud, primary_pic_type, 0U, 7U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -647,8 +922,8 @@ h264_parser_status_e h264_parser::parse_sps(istream_be& s)
         s.read_u8(constraint_flags);
         s.read_u8(level_idc);
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(seq_parameter_set_id), std::cout) ||
-            !CHK_RANGE(seq_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_SPS - 1), std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(seq_parameter_set_id), *m_ostream) ||
+            !CHK_RANGE(seq_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_SPS - 1), *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -667,7 +942,7 @@ h264_parser_status_e h264_parser::parse_sps(istream_be& s)
             sps.profile_idc == 128 || sps.profile_idc == 144) {
 
             s.read_exp_golomb_u(sps.chroma_format_idc);
-            if (!CHK_STRUCT_RANGE(sps, chroma_format_idc, 0U, 3U, std::cout)) {
+            if (!CHK_STRUCT_RANGE(sps, chroma_format_idc, 0U, 3U, *m_ostream)) {
                 s.mark_corrupted();
                 break;
             }
@@ -678,13 +953,13 @@ h264_parser_status_e h264_parser::parse_sps(istream_be& s)
                 sps.separate_colour_plane_flag = 0;
 
             s.read_exp_golomb_u(sps.bit_depth_luma_minus8);
-            if (!CHK_STRUCT_RANGE(sps, bit_depth_luma_minus8, 0U, 6U, std::cout)) {
+            if (!CHK_STRUCT_RANGE(sps, bit_depth_luma_minus8, 0U, 6U, *m_ostream)) {
                 s.mark_corrupted();
                 break;
             }
 
             s.read_exp_golomb_u(sps.bit_depth_chroma_minus8);
-            if (!CHK_STRUCT_RANGE(sps, bit_depth_chroma_minus8, 0U, 6U, std::cout)) {
+            if (!CHK_STRUCT_RANGE(sps, bit_depth_chroma_minus8, 0U, 6U, *m_ostream)) {
                 s.mark_corrupted();
                 break;
             }
@@ -742,13 +1017,13 @@ h264_parser_status_e h264_parser::parse_sps(istream_be& s)
         }
 
         s.read_exp_golomb_u(sps.log2_max_frame_num_minus4);
-        if (!CHK_STRUCT_RANGE(sps, log2_max_frame_num_minus4, 0U, 12U, std::cout)) {
+        if (!CHK_STRUCT_RANGE(sps, log2_max_frame_num_minus4, 0U, 12U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
         s.read_exp_golomb_u(sps.pic_order_cnt_type);
-        if (!CHK_STRUCT_RANGE(sps, pic_order_cnt_type, 0U, 2U, std::cout)) {
+        if (!CHK_STRUCT_RANGE(sps, pic_order_cnt_type, 0U, 2U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -761,7 +1036,7 @@ h264_parser_status_e h264_parser::parse_sps(istream_be& s)
             s.read_exp_golomb_s(sps.t1.offset_for_non_ref_pic);
             s.read_exp_golomb_s(sps.t1.offset_for_top_to_bottom_field);
             s.read_exp_golomb_u(sps.t1.num_ref_frames_in_pic_order_cnt_cycle);
-            if (!CHK_STRUCT_RANGE(sps, t1.num_ref_frames_in_pic_order_cnt_cycle, 0U, 255U, std::cout)) {
+            if (!CHK_STRUCT_RANGE(sps, t1.num_ref_frames_in_pic_order_cnt_cycle, 0U, 255U, *m_ostream)) {
                 s.mark_corrupted();
                 break;
             }
@@ -828,8 +1103,8 @@ h264_parser_status_e h264_parser::parse_pps(istream_be& s)
         uint32_t pic_parameter_set_id;
         uint32_t seq_parameter_set_id;
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(pic_parameter_set_id), std::cout) ||
-            !CHK_RANGE(pic_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_PPS - 1), std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(pic_parameter_set_id), *m_ostream) ||
+            !CHK_RANGE(pic_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_PPS - 1), *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -837,17 +1112,17 @@ h264_parser_status_e h264_parser::parse_pps(istream_be& s)
         h264::pps& pps = m_pps_table[pic_parameter_set_id];
         pps.reset();
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(seq_parameter_set_id), std::cout) ||
-            !CHK_RANGE(seq_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_SPS - 1), std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(seq_parameter_set_id), *m_ostream) ||
+            !CHK_RANGE(seq_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_SPS - 1), *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
         h264::sps& sps = m_sps_table[seq_parameter_set_id];
         if (!sps.is_valid()) {
-            std::cout << "error: pps #" << pic_parameter_set_id;
-            std::cout << " refers to sps #" << seq_parameter_set_id << " which is not valid";
-            std::cout << std::endl;
+            *m_ostream << "error: pps #" << pic_parameter_set_id;
+            *m_ostream << " refers to sps #" << seq_parameter_set_id << " which is not valid";
+            *m_ostream << std::endl;
             break;
         }
 
@@ -859,8 +1134,8 @@ h264_parser_status_e h264_parser::parse_pps(istream_be& s)
         s.read_bits(1, pps.entropy_coding_mode_flag);
         s.read_bits(1, pps.bottom_field_pic_order_in_frame_present_flag);
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(pps.num_slice_groups_minus1), std::cout) ||
-            !CHK_STRUCT_RANGE(pps, num_slice_groups_minus1, 0U, 7U, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(pps.num_slice_groups_minus1), *m_ostream) ||
+            !CHK_STRUCT_RANGE(pps, num_slice_groups_minus1, 0U, 7U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -870,8 +1145,8 @@ h264_parser_status_e h264_parser::parse_pps(istream_be& s)
             /* slice_group_map_type specifies how the mapping of slice group map */
             /* units to slice groups is coded. The value of slice_group_map_type */
             /* shall be in the range of 0 to 6, inclusive.*/
-            if (!CHK_EXPR(s.read_exp_golomb_u(pps.slice_group_map_type), std::cout) ||
-                !CHK_STRUCT_RANGE(pps, slice_group_map_type, 0U, 6U, std::cout)) {
+            if (!CHK_EXPR(s.read_exp_golomb_u(pps.slice_group_map_type), *m_ostream) ||
+                !CHK_STRUCT_RANGE(pps, slice_group_map_type, 0U, 6U, *m_ostream)) {
                 s.mark_corrupted();
                 break;
             }
@@ -902,14 +1177,14 @@ h264_parser_status_e h264_parser::parse_pps(istream_be& s)
             }
         }
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(pps.num_ref_idx_l0_default_active_minus1), std::cout) ||
-            !CHK_STRUCT_RANGE(pps, num_ref_idx_l0_default_active_minus1, 0U, 31U, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(pps.num_ref_idx_l0_default_active_minus1), *m_ostream) ||
+            !CHK_STRUCT_RANGE(pps, num_ref_idx_l0_default_active_minus1, 0U, 31U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(pps.num_ref_idx_l1_default_active_minus1), std::cout) ||
-            !CHK_STRUCT_RANGE(pps, num_ref_idx_l1_default_active_minus1, 0U, 31U, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(pps.num_ref_idx_l1_default_active_minus1), *m_ostream) ||
+            !CHK_STRUCT_RANGE(pps, num_ref_idx_l1_default_active_minus1, 0U, 31U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -917,20 +1192,20 @@ h264_parser_status_e h264_parser::parse_pps(istream_be& s)
         s.read_bits(1, pps.weighted_pred_flag);
         s.read_bits(2, pps.weighted_bipred_idc);
 
-        if (!CHK_EXPR(s.read_exp_golomb_s(pps.pic_init_qp_minus26), std::cout) ||
-            !CHK_STRUCT_RANGE(pps, pic_init_qp_minus26, -26 - 6 * static_cast<int>(sps.bit_depth_luma_minus8), +25, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_s(pps.pic_init_qp_minus26), *m_ostream) ||
+            !CHK_STRUCT_RANGE(pps, pic_init_qp_minus26, -26 - 6 * static_cast<int>(sps.bit_depth_luma_minus8), +25, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
-        if (!CHK_EXPR(s.read_exp_golomb_s(pps.pic_init_qs_minus26), std::cout) ||
-            !CHK_STRUCT_RANGE(pps, pic_init_qs_minus26, -26, +25, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_s(pps.pic_init_qs_minus26), *m_ostream) ||
+            !CHK_STRUCT_RANGE(pps, pic_init_qs_minus26, -26, +25, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
-        if (!CHK_EXPR(s.read_exp_golomb_s(pps.chroma_qp_index_offset), std::cout) ||
-            !CHK_STRUCT_RANGE(pps, chroma_qp_index_offset, -12, +12, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_s(pps.chroma_qp_index_offset), *m_ostream) ||
+            !CHK_STRUCT_RANGE(pps, chroma_qp_index_offset, -12, +12, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -1079,24 +1354,24 @@ h264_parser_status_e h264_parser::parse_slice_header(istream_be& s, uint32_t nal
 
         s.read_exp_golomb_u(slice_header.first_mb_in_slice);
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(slice_type), std::cout) ||
-            !CHK_RANGE(slice_type, 0U, 9U, std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(slice_type), *m_ostream) ||
+            !CHK_RANGE(slice_type, 0U, 9U, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
         slice_header.slice_type = slice_type;
 
-        if (!CHK_EXPR(s.read_exp_golomb_u(pic_parameter_set_id), std::cout) ||
-            !CHK_RANGE(pic_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_PPS - 1), std::cout)) {
+        if (!CHK_EXPR(s.read_exp_golomb_u(pic_parameter_set_id), *m_ostream) ||
+            !CHK_RANGE(pic_parameter_set_id, 0U, static_cast<unsigned>(H264_PARSER_MAX_NUMBER_OF_PPS - 1), *m_ostream)) {
             s.mark_corrupted();
             break;
         }
 
         h264::pps& pps = m_pps_table[pic_parameter_set_id];
         if (!pps.is_valid()) {
-            std::cout << "error: slice header refers to pps #" << pic_parameter_set_id << " which is not valid";
-            std::cout << std::endl;
+            *m_ostream << "error: slice header refers to pps #" << pic_parameter_set_id << " which is not valid";
+            *m_ostream << std::endl;
             break;
         }
 
@@ -1104,9 +1379,9 @@ h264_parser_status_e h264_parser::parse_slice_header(istream_be& s, uint32_t nal
 
         h264::sps& sps = m_sps_table[seq_parameter_set_id];
         if (!sps.is_valid()) {
-            std::cout << "error: pps #" << pic_parameter_set_id;
-            std::cout << " refers to sps #" << seq_parameter_set_id << " which is not valid";
-            std::cout << std::endl;
+            *m_ostream << "error: pps #" << pic_parameter_set_id;
+            *m_ostream << " refers to sps #" << seq_parameter_set_id << " which is not valid";
+            *m_ostream << std::endl;
             break;
         }
 
@@ -1154,14 +1429,14 @@ h264_parser_status_e h264_parser::parse_slice_header(istream_be& s, uint32_t nal
             h264::slice_type_e::B  == slice_type) {
             s.read_bits(1, slice_header.num_ref_idx_active_override_flag);
             if (slice_header.num_ref_idx_active_override_flag) {
-                if (!CHK_EXPR(s.read_exp_golomb_u(slice_header.num_ref_idx_l0_active_minus1), std::cout) ||
-                    !CHK_STRUCT_RANGE(slice_header, num_ref_idx_l0_active_minus1, 0U, 31U, std::cout)) {
+                if (!CHK_EXPR(s.read_exp_golomb_u(slice_header.num_ref_idx_l0_active_minus1), *m_ostream) ||
+                    !CHK_STRUCT_RANGE(slice_header, num_ref_idx_l0_active_minus1, 0U, 31U, *m_ostream)) {
                     s.mark_corrupted();
                     break;
                 }
                 if (h264::slice_type_e::B == slice_type)
-                    if (!CHK_EXPR(s.read_exp_golomb_u(slice_header.num_ref_idx_l1_active_minus1), std::cout) ||
-                        !CHK_STRUCT_RANGE(slice_header, num_ref_idx_l1_active_minus1, 0U, 31U, std::cout)) {
+                    if (!CHK_EXPR(s.read_exp_golomb_u(slice_header.num_ref_idx_l1_active_minus1), *m_ostream) ||
+                        !CHK_STRUCT_RANGE(slice_header, num_ref_idx_l1_active_minus1, 0U, 31U, *m_ostream)) {
                         s.mark_corrupted();
                         break;
                     }
@@ -1209,17 +1484,17 @@ h264_parser_status_e h264_parser::parse_slice_header(istream_be& s, uint32_t nal
 
         if ((pps.entropy_coding_mode_flag) &&
             (h264::slice_type_e::I != slice_type) && (h264::slice_type_e::SI != slice_type)) {
-            if (!CHK_EXPR(s.read_exp_golomb_u(slice_header.cabac_init_idc), std::cout) ||
-                !CHK_STRUCT_RANGE(slice_header, cabac_init_idc, 0U, 2U, std::cout)) {
+            if (!CHK_EXPR(s.read_exp_golomb_u(slice_header.cabac_init_idc), *m_ostream) ||
+                !CHK_STRUCT_RANGE(slice_header, cabac_init_idc, 0U, 2U, *m_ostream)) {
                 s.mark_corrupted();
                 break;
             }
         }
 
-        if (!CHK_EXPR(s.read_exp_golomb_s(slice_header.slice_qp_delta), std::cout) ||
+        if (!CHK_EXPR(s.read_exp_golomb_s(slice_header.slice_qp_delta), *m_ostream) ||
             !CHK_STRUCT_RANGE(slice_header, slice_qp_delta,
                 -26 - 6 * static_cast<int>(sps.bit_depth_luma_minus8) - pps.pic_init_qp_minus26,
-                 25 - pps.pic_init_qp_minus26, std::cout)) {
+                 25 - pps.pic_init_qp_minus26, *m_ostream)) {
             s.mark_corrupted();
             break;
         }
@@ -1271,12 +1546,6 @@ h264_parser_status_e h264_parser::parse_nal_unit(istream_be& s)
     nal_ref_idc = (nal_header & 0x60) >> 5;
     nal_unit_type = nal_header & 0x1f;
 
-    std::cout << std::endl;
-    std::cout << "nal_unit_type: " << nal_unit_type;
-    std::cout << " '" << ymn::to_string(static_cast<nal_unit_type_e>(nal_unit_type)) << "'";
-    std::cout << " size: " << s.size();
-    std::cout << std::endl;
-
     switch (static_cast<nal_unit_type_e>(nal_unit_type)) {
         case nal_unit_type_e::AUD:
             return parse_aud(s);
@@ -1301,6 +1570,36 @@ h264_parser_status_e h264_parser::parse_nal_unit(istream_be& s)
     return h264_parser_status_e::NAL_UNIT_SKIPPED;
 }
 
+h264_parser_status_e h264_parser::parse_length_prefixed_nal_units()
+{
+    std::size_t available;
+    std::size_t num_bytes_in_nal_unit;
+    const uint8_t* p;
+
+    available = m_flatbuffer.read_available();
+    if (available < m_nal_length_size)
+        return h264_parser_status_e::NEED_BYTES;
+
+    p = m_flatbuffer.read_ptr();
+
+    num_bytes_in_nal_unit = 0;
+    for (uint32_t i = 0; i < m_nal_length_size; ++i)
+        num_bytes_in_nal_unit = (num_bytes_in_nal_unit << 8) | p[i];
+
+    if (available - m_nal_length_size < num_bytes_in_nal_unit)
+        return h264_parser_status_e::NEED_BYTES;
+
+    /* data stays intact until next write(), so it can be parsed after being consumed */
+    m_flatbuffer.consume(m_nal_length_size + num_bytes_in_nal_unit);
+
+    if (0 == num_bytes_in_nal_unit)
+        return h264_parser_status_e::NAL_UNIT_CORRUPTED;
+
+    update_timestamps(p);
+
+    return parse_nal_unit(p + m_nal_length_size, num_bytes_in_nal_unit);
+}
+
 h264_parser_status_e h264_parser::parse_nal_units()
 {
     h264_parser_status_e status = h264_parser_status_e::NEED_BYTES;
@@ -1314,26 +1613,31 @@ h264_parser_status_e h264_parser::parse_byte_stream_nal_units()
     int num_bytes_in_nal_unit;
 
     if ((num_bytes_in_nal_unit = find_nal_unit()) > 0) {
-        int rbsp_size;
-        uint8_t* rbsp_buf;
-        const uint8_t* p = m_flatbuffer.get_bookmark();
+        update_timestamps(m_flatbuffer.get_bookmark());
+        status = parse_nal_unit(m_flatbuffer.get_bookmark(), num_bytes_in_nal_unit);
+        m_flatbuffer.clear_bookmark();
+    }
 
-        rbsp_buf = new uint8_t[num_bytes_in_nal_unit];
-        rbsp_size = h264_parser_nal_to_rbsp(rbsp_buf, num_bytes_in_nal_unit, p, num_bytes_in_nal_unit);
+    return status;
+}
 
-        if (rbsp_size > 0) {
-            istream_be s(rbsp_buf, rbsp_size);
+void h264_parser::update_timestamps(const uint8_t* nal_unit)
+{
+    const uint8_t* end;
+    std::size_t position;
 
-            status = parse_nal_unit(s);
-        }
-        else
-            status = h264_parser_status_e::NAL_UNIT_CORRUPTED;
+    if (m_pending_timestamps.empty() || m_flatbuffer.is_attached())
+        return;
 
-        delete [] rbsp_buf;
-        m_flatbuffer.clear_bookmark();
-    }
+    /* position of the NAL unit in the data written so far */
+    end = m_flatbuffer.read_ptr() + m_flatbuffer.read_available();
+    position = m_bytes_written - (end - nal_unit);
 
-    return status;
+    while (!m_pending_timestamps.empty() && (m_pending_timestamps.front().position <= position)) {
+        m_pts = m_pending_timestamps.front().pts;
+        m_dts = m_pending_timestamps.front().dts;
+        m_pending_timestamps.pop_front();
+    }
 }
 
 void h264_parser::set_slice_data(istream_be& s)
@@ -1345,82 +1649,66 @@ void h264_parser::set_slice_data(istream_be& s)
         if (s.status() != ISTREAM_STATUS_OK)
             break;
 
-        m_slice_data.data = s.current_data_pointer();
-        m_slice_data.size = s.remains();
+        /* find NAL unit byte holding the current RBSP byte */
+        const std::size_t rbsp_position = s.tell();
+        std::size_t i = 0, j = 0, zero_bytes = 0;
+
+        while (i < m_nal_unit_size) {
+            if ((zero_bytes == 2) && (m_nal_unit[i] == 0x03)) {
+                /* emulation_prevention_three_byte */
+                zero_bytes = 0;
+                i++;
+                continue;
+            }
+
+            if (j == rbsp_position)
+                break;
+
+            zero_bytes = (m_nal_unit[i] == 0x00) ? zero_bytes + 1 : 0;
+            i++;
+            j++;
+        }
+
+        m_slice_data.data = m_nal_unit + i;
+        m_slice_data.size = m_nal_unit_size - i;
         m_slice_data.bit_pos = s.tell_bits();
+        m_slice_data.zero_bytes = zero_bytes;
 
         slice_data.set_valid(true);
     } while (0);
 }
 
-/*===========================================================================*\
- * local function definitions
-\*===========================================================================*/
-/**
- * Converts NAL data to RBSP data.
- *
- * The size of 'rbsp_buf' cannot be smaller than the size of the 'nal_buf'
- * to guarantee the output will fit.
- * If that is not true, output may be truncated and an error will be returned.
- * Additionally, certain byte sequences in the input 'nal_buf'
- * are not allowed in the spec and also cause the conversion to fail
- * and an error to be returned.
- *
- * @param[in,out] rbsp_buf  Pointer to the buffer in which to put the rbsp data.
- * @param[in]     rbsp_size Maximum size of the rbsp data.
- * @param[in]     nal_buf   Pointer to the buffer containing nal data.
- * @param[in]     nal_size  Size of the nal data.
- *
- * @return Actual size of rbsp data, or -1 on error.
- *
- * @note 7.3.1 NAL unit syntax
- * @note 7.4.1.1 Encapsulation of an SODB within an RBSP
- */
-static int h264_parser_nal_to_rbsp(
-    uint8_t* rbsp_buf, std::size_t rbsp_size, const uint8_t* nal_buf, std::size_t nal_size)
+bool h264_parser::is_intra_slice(const uint8_t* nal_unit, std::size_t size, bool& parsable) const
 {
-    std::size_t i     = 0;
-    std::size_t j     = 0;
-    std::size_t count = 0;
-
-    while (i < nal_size) {
-        /* within the NAL unit, the following three-byte sequences shall not occur */
-        /* at any byte-aligned position: 0x000000, 0x000001, 0x000002 */
-        if ((count == 2) && (nal_buf[i] < 0x03))
-            return -1;
+    rbsp_istream s(nal_unit + 1, size - 1);
+    uint32_t first_mb_in_slice;
+    uint32_t slice_type;
+    uint32_t pic_parameter_set_id;
 
-        if ((count == 2) && (nal_buf[i] == 0x03)) {
-            /* within the NAL unit, any four-byte sequence that starts with 0x000003 */
-            /* other than the following sequences shall not occur at any byte-aligned position: */
-            /* 0x00000300, 0x00000301, 0x00000302, 0x00000303 */
-            /* check the 4th byte after 0x000003, except when cabac_zero_word is used, */
-            /* in which case the last three bytes of this NAL unit must be 0x000003 */
-            if((i < nal_size - 1) && (nal_buf[i + 1] > 0x03))
-                return -1;
-
-            /* if cabac_zero_word is used, the final byte of this NAL unit(0x03) is discarded, */
-            /* and the last two bytes of RBSP must be 0x0000 */
-            if (i == nal_size - 1)
-                break;
+    parsable = false;
 
-            i++;
-            count = 0;
-        }
+    /* undecidable slices are left to the slice header parser */
+    if (!s.read_exp_golomb_u(first_mb_in_slice) || !s.read_exp_golomb_u(slice_type))
+        return true;
 
-        if (j >= rbsp_size)
-            return -1; /* error, not enough space */
+    switch (static_cast<h264::slice_type_e>(slice_type % 5)) {
+        case h264::slice_type_e::I:
+        case h264::slice_type_e::SI:
+            return true;
 
-        rbsp_buf[j] = nal_buf[i];
-
-        if(nal_buf[i] == 0x00)
-            count++;
-        else
-            count = 0;
+        default:
+            break;
+    }
 
-        i++;
-        j++;
+    if (s.read_exp_golomb_u(pic_parameter_set_id) && (pic_parameter_set_id < H264_PARSER_MAX_NUMBER_OF_PPS)) {
+        const h264::pps& pps = m_pps_table[pic_parameter_set_id];
+        parsable = pps.is_valid() && (pps.seq_parameter_set_id < H264_PARSER_MAX_NUMBER_OF_SPS) &&
+            m_sps_table[pps.seq_parameter_set_id].is_valid();
     }
 
-    return j;
+    return false;
 }
 
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
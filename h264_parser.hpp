@@ -26,6 +26,8 @@
  * system header files
 \*===========================================================================*/
 #include <sstream>
+#include <deque>
+#include <vector>
 #include <cstring>
 #include <functional> /* for std::function */
 
@@ -41,6 +43,7 @@
 
 #include "h264_structure.hpp"
 #include "aud.hpp"
+#include "avcc.hpp"
 #include "sps.hpp"
 #include "pps.hpp"
 #include "sei.hpp"
@@ -53,6 +56,7 @@
 #define H264_PARSER_CONTAINERS \
     H264_PARSER_CONTAINER(NONE) \
     H264_PARSER_CONTAINER(ANNEX_B) \
+    H264_PARSER_CONTAINER(AVCC) \
 
 #define H264_PARSER_STATUSES \
     H264_PARSER_STATUS(NEED_BYTES) \
@@ -63,6 +67,7 @@
     H264_PARSER_STATUS(PPS_PARSED) \
     H264_PARSER_STATUS(SEI_PARSED) \
     H264_PARSER_STATUS(SLICE_PARSED) \
+    H264_PARSER_STATUS(SLICE_SKIPPED) \
 
 #define H264_PARSER_STRUCTURES \
     H264_PARSER_STRUCTURE(AUD) \
@@ -76,6 +81,13 @@
 #define H264_PARSER_MAX_NUMBER_OF_PPS         256
 #define H264_PARSER_STRUCTURE_ID_RECENT       (-1)
 #define H264_PARSER_STRUCTURE_ID_PREVIOUS     (-2)
+#define H264_PARSER_DEFAULT_NAL_LENGTH_SIZE     4
+#define H264_PARSER_NO_TIMESTAMP              UINT64_MAX
+/* zeroed bytes following RBSP data, so that bit readers may safely read ahead */
+#define H264_PARSER_RBSP_PADDING               32
+/* only that many first bytes of slice NAL units are converted to RBSP (for slice header),
+   slice data is read directly from the NAL unit (see rbsp_istream) */
+#define H264_PARSER_SLICE_HEADER_PREFIX_SIZE 4096
 
 /*===========================================================================*\
  * inline function definitions
@@ -157,6 +169,16 @@ public:
     explicit h264_parser(std::size_t capacity, h264_parser_container_e container) :
         base_parser<uint8_t>(capacity),
         m_parse_function(nullptr),
+        m_nal_length_size(H264_PARSER_DEFAULT_NAL_LENGTH_SIZE),
+        m_intra_only(false),
+        m_ostream(&std::cout),
+        m_bytes_written(0),
+        m_pending_timestamps(),
+        m_pts(H264_PARSER_NO_TIMESTAMP),
+        m_dts(H264_PARSER_NO_TIMESTAMP),
+        m_rbsp(),
+        m_nal_unit(nullptr),
+        m_nal_unit_size(0),
         m_aud(),
         m_sps_table(),
         m_recent_sps(-1),
@@ -175,6 +197,10 @@ public:
                 m_parse_function = &h264_parser::parse_byte_stream_nal_units;
                 break;
 
+            case h264_parser_container_e::AVCC:
+                m_parse_function = &h264_parser::parse_length_prefixed_nal_units;
+                break;
+
             default:
                 /* do nothing */
                 break;
@@ -203,6 +229,32 @@ public:
         base_parser::reset();
     }
 
+    /**
+     * Resets the parser and forgets all parsed structures (parameter sets
+     * in particular), so that it can be reused for an unrelated stream.
+     */
+    void clear()
+    {
+        reset();
+        shrink_buffer();
+
+        m_bytes_written = 0;
+        m_pending_timestamps.clear();
+        m_pts = H264_PARSER_NO_TIMESTAMP;
+        m_dts = H264_PARSER_NO_TIMESTAMP;
+
+        m_aud.reset();
+        for (auto& sps : m_sps_table)
+            sps.reset();
+        m_recent_sps = -1;
+        for (auto& pps : m_pps_table)
+            pps.reset();
+        m_recent_pps = -1;
+        m_sei.reset();
+        m_slice_header.reset();
+        m_slice_data.reset();
+    }
+
     std::string to_string() const
     {
         std::ostringstream stream;
@@ -225,6 +277,120 @@ public:
         return (this->*m_parse_function)();
     }
 
+    std::size_t write(const uint8_t data[], std::size_t count)
+    {
+        std::size_t n_written = base_parser::write(data, count);
+
+        m_bytes_written += n_written;
+
+        return n_written;
+    }
+
+    /**
+     * Tells that data written next (e.g. payload of a PES packet)
+     * carries given presentation and decoding timestamps.
+     * They are taken over by the first NAL unit starting in that data
+     * and by all the following ones, up to the data with next timestamps.
+     * Works for data passed by write() only.
+     *
+     * @param[in] pts Presentation timestamp.
+     * @param[in] dts Decoding timestamp (equal to pts if not sent).
+     */
+    void set_timestamps(uint64_t pts, uint64_t dts)
+    {
+        m_pending_timestamps.push_back({m_bytes_written, pts, dts});
+    }
+
+    /**
+     * @return Presentation timestamp of recently parsed NAL unit,
+     *         H264_PARSER_NO_TIMESTAMP if stream does not carry timestamps.
+     */
+    uint64_t get_pts() const
+    {
+        return m_pts;
+    }
+
+    /**
+     * @return Decoding timestamp of recently parsed NAL unit,
+     *         H264_PARSER_NO_TIMESTAMP if stream does not carry timestamps.
+     */
+    uint64_t get_dts() const
+    {
+        return m_dts;
+    }
+
+    /**
+     * Signals end of the stream (or of a self-contained part of it).
+     * In annex b byte stream the last NAL unit is terminated by the next
+     * start code, so without flush() it would never be parsed.
+     * All data remaining in parser's flatbuffer is dropped afterwards.
+     *
+     * @return Status of parsing of the last NAL unit,
+     *         NEED_BYTES if there was nothing to parse.
+     */
+    h264_parser_status_e flush();
+
+    /**
+     * Parses one complete NAL unit delivered by the caller
+     * (e.g. depacketized from RTP), bypassing parser's flatbuffer
+     * and start code scanning.
+     *
+     * @param[in] nal_unit Pointer to the first byte of the NAL unit (NAL unit header).
+     * @param[in] size     Number of bytes composing the NAL unit.
+     *
+     * @return Status of the parsing operation.
+     */
+    h264_parser_status_e parse_nal_unit(const uint8_t* nal_unit, std::size_t size);
+
+    /**
+     * Sets size (in bytes) of the NAL unit length field
+     * preceding every NAL unit in AVCC container.
+     *
+     * @param[in] nal_length_size 1, 2 or 4.
+     *
+     * @return true on success, false if nal_length_size is not supported.
+     */
+    bool set_nal_length_size(uint32_t nal_length_size)
+    {
+        if ((nal_length_size != 1) && (nal_length_size != 2) && (nal_length_size != 4))
+            return false;
+
+        m_nal_length_size = nal_length_size;
+        return true;
+    }
+
+    uint32_t get_nal_length_size() const
+    {
+        return m_nal_length_size;
+    }
+
+    /**
+     * Drops slices other than I and SI ones right after first_mb_in_slice
+     * and slice_type are read from the NAL unit, so that their headers
+     * are not parsed and their bytes are not converted to RBSP.
+     * Dropped slices are reported as SLICE_SKIPPED (NAL_UNIT_SKIPPED
+     * if they refer to parameter sets not received yet).
+     */
+    void set_intra_only(bool intra_only)
+    {
+        m_intra_only = intra_only;
+    }
+
+    /**
+     * Redirects parser's log (parsed NAL units and errors) from std::cout
+     * to the given stream, e.g. to keep logs of parsers running
+     * in different threads apart.
+     */
+    void set_ostream(std::ostream& ostream)
+    {
+        m_ostream = &ostream;
+    }
+
+    std::ostream& get_ostream() const
+    {
+        return *m_ostream;
+    }
+
     /**
      * Gives pointer to the requested structure.
      *
@@ -245,6 +411,20 @@ public:
 private:
     using parse_function_t = h264_parser_status_e (h264_parser::*)();
 
+    struct timestamps
+    {
+        std::size_t position; /* in bytes written so far */
+        uint64_t pts;
+        uint64_t dts;
+    };
+
+    /**
+     * Takes over timestamps of the data NAL unit starts in.
+     *
+     * @param[in] nal_unit Pointer to the NAL unit in parser's flatbuffer.
+     */
+    void update_timestamps(const uint8_t* nal_unit);
+
     /**
      * Finds 'next_start_code (0x000001)' pattern in parser's flatbuffer.
      *
@@ -289,10 +469,35 @@ private:
 
     h264_parser_status_e parse_nal_units();
     h264_parser_status_e parse_byte_stream_nal_units();
+    h264_parser_status_e parse_length_prefixed_nal_units();
 
     void set_slice_data(istream_be& s);
 
+    /**
+     * Tells whether non-IDR slice is an I or SI one, reading only
+     * its first bytes (no RBSP conversion). For other slices also tells
+     * whether parameter sets they refer to are known, i.e. whether
+     * their headers would be parsed if they were not dropped.
+     */
+    bool is_intra_slice(const uint8_t* nal_unit, std::size_t size, bool& parsable) const;
+
     parse_function_t m_parse_function;
+    uint32_t m_nal_length_size;
+    bool m_intra_only;
+    std::ostream* m_ostream;
+
+    std::size_t m_bytes_written;
+    std::deque<timestamps> m_pending_timestamps;
+    uint64_t m_pts;
+    uint64_t m_dts;
+
+    /* RBSP of the recently parsed NAL unit (m_slice_data points into it),
+       reused by subsequent NAL units and only grown when they do not fit */
+    std::vector<uint8_t> m_rbsp;
+
+    /* NAL unit being parsed (m_rbsp holds its beginning or whole of it) */
+    const uint8_t* m_nal_unit;
+    std::size_t m_nal_unit_size;
 
     h264::aud m_aud;
 
@@ -324,6 +529,42 @@ namespace ymn
 namespace ymn
 {
 
+/**
+ * Converts NAL data to RBSP data.
+ *
+ * The size of 'rbsp_buf' cannot be smaller than the size of the 'nal_buf'
+ * to guarantee the output will fit.
+ * If that is not true, output may be truncated and an error will be returned.
+ * Additionally, certain byte sequences in the input 'nal_buf'
+ * are not allowed in the spec and also cause the conversion to fail
+ * and an error to be returned.
+ *
+ * @param[in,out] rbsp_buf  Pointer to the buffer in which to put the rbsp data.
+ * @param[in]     rbsp_size Maximum size of the rbsp data.
+ * @param[in]     nal_buf   Pointer to the buffer containing nal data.
+ * @param[in]     nal_size  Size of the nal data.
+ *
+ * @return Actual size of rbsp data, or -1 on error.
+ *
+ * @note 7.3.1 NAL unit syntax
+ * @note 7.4.1.1 Encapsulation of an SODB within an RBSP
+ */
+int h264_parser_nal_to_rbsp(
+    uint8_t* rbsp_buf, std::size_t rbsp_size, const uint8_t* nal_buf, std::size_t nal_size);
+
+/**
+ * Parses AVCDecoderConfigurationRecord (avcC box payload).
+ * Parameter sets carried by the record are not parsed,
+ * they are only located (see h264::avcc::nal_unit).
+ *
+ * @param[in]  record Pointer to the first byte of the record.
+ * @param[in]  size   Size of the record.
+ * @param[out] avcc   Parsed record.
+ *
+ * @return true on success, false if record is malformed.
+ */
+bool h264_parse_avc_decoder_configuration_record(const uint8_t* record, std::size_t size, h264::avcc& avcc);
+
 } /* end of namespace ymn */
 
 #endif /* _H264_PARSER_HPP_ */
@@ -0,0 +1,492 @@
+/**
+ * @file keyframe_index.cpp
+ *
+ * Keyframe index (and its builder).
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#include <cstring>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "keyframe_index.hpp"
+#include "nal_unit_type.hpp"
+#include "istream.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define KEYFRAME_INDEX_MAGIC                  "H264IDX"
+#define KEYFRAME_INDEX_MAGIC_SIZE             8
+#define KEYFRAME_INDEX_FLAG_TS                0x00000001
+
+/* enough to get first_mb_in_slice, slice_type and pic_parameter_set_id */
+#define KEYFRAME_INDEXER_SLICE_HEADER_SIZE    32
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+/* little endian serialization of the index */
+struct keyframe_index_writer
+{
+    void u32(uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+            data.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void u64(uint64_t v)
+    {
+        u32(static_cast<uint32_t>(v));
+        u32(static_cast<uint32_t>(v >> 32));
+    }
+
+    void bytes(const uint8_t* p, std::size_t count)
+    {
+        data.insert(data.end(), p, p + count);
+    }
+
+    std::vector<uint8_t> data;
+};
+
+struct keyframe_index_reader
+{
+    bool u32(uint32_t& v)
+    {
+        if (end - p < 4)
+            return false;
+        v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        p += 4;
+        return true;
+    }
+
+    bool u64(uint64_t& v)
+    {
+        uint32_t lo, hi;
+
+        if (!u32(lo) || !u32(hi))
+            return false;
+        v = (static_cast<uint64_t>(hi) << 32) | lo;
+        return true;
+    }
+
+    bool bytes(std::vector<uint8_t>& v, std::size_t count)
+    {
+        if (static_cast<std::size_t>(end - p) < count)
+            return false;
+        v.assign(p, p + count);
+        p += count;
+        return true;
+    }
+
+    const uint8_t* p;
+    const uint8_t* end;
+};
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+bool keyframe_index::save(const char* filename) const
+{
+    keyframe_index_writer w;
+    char magic[KEYFRAME_INDEX_MAGIC_SIZE] = KEYFRAME_INDEX_MAGIC;
+
+    w.bytes(reinterpret_cast<const uint8_t*>(magic), sizeof(magic));
+    w.u32(KEYFRAME_INDEX_VERSION);
+    w.u32(ts ? KEYFRAME_INDEX_FLAG_TS : 0);
+    w.u32(pid);
+    w.u32(tspacket_size);
+    w.u64(file_size);
+    w.u32(parameter_sets.size());
+    w.u32(keyframes.size());
+
+    for (const auto& ps : parameter_sets) {
+        w.u32(ps.nal_unit_type);
+        w.u32(ps.id);
+        w.u64(ps.offset);
+        w.u32(ps.nal_unit.size());
+        w.bytes(ps.nal_unit.data(), ps.nal_unit.size());
+    }
+
+    for (const auto& kf : keyframes) {
+        w.u64(kf.offset);
+        w.u64(kf.size);
+        w.u64(kf.pts);
+        w.u32(kf.nal_unit_type);
+        w.u32(kf.sps);
+        w.u32(kf.pps);
+    }
+
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    file.write(reinterpret_cast<const char*>(w.data.data()), w.data.size());
+    file.close();
+
+    return !file.fail();
+}
+
+bool keyframe_index::load(const char* filename)
+{
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> magic;
+    keyframe_index_reader r;
+    uint32_t version, flags, number_of_parameter_sets, number_of_keyframes;
+
+    reset();
+
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    file.close();
+
+    r.p = data.data();
+    r.end = data.data() + data.size();
+
+    if (!r.bytes(magic, KEYFRAME_INDEX_MAGIC_SIZE) ||
+        (0 != std::memcmp(magic.data(), KEYFRAME_INDEX_MAGIC, KEYFRAME_INDEX_MAGIC_SIZE)))
+        return false;
+
+    if (!r.u32(version) || (KEYFRAME_INDEX_VERSION != version))
+        return false;
+
+    if (!r.u32(flags) || !r.u32(pid) || !r.u32(tspacket_size) || !r.u64(file_size) ||
+        !r.u32(number_of_parameter_sets) || !r.u32(number_of_keyframes))
+        return false;
+
+    ts = flags & KEYFRAME_INDEX_FLAG_TS;
+
+    for (uint32_t i = 0; i < number_of_parameter_sets; ++i) {
+        parameter_set ps;
+        uint32_t size;
+
+        if (!r.u32(ps.nal_unit_type) || !r.u32(ps.id) || !r.u64(ps.offset) || !r.u32(size) ||
+            (size > KEYFRAME_INDEX_MAX_PARAMETER_SET_SIZE) || !r.bytes(ps.nal_unit, size))
+            return false;
+
+        parameter_sets.push_back(std::move(ps));
+    }
+
+    for (uint32_t i = 0; i < number_of_keyframes; ++i) {
+        keyframe kf;
+
+        if (!r.u64(kf.offset) || !r.u64(kf.size) || !r.u64(kf.pts) ||
+            !r.u32(kf.nal_unit_type) || !r.u32(kf.sps) || !r.u32(kf.pps))
+            return false;
+
+        if (((kf.sps != KEYFRAME_INDEX_NO_PARAMETER_SET) && (kf.sps >= parameter_sets.size())) ||
+            ((kf.pps != KEYFRAME_INDEX_NO_PARAMETER_SET) && (kf.pps >= parameter_sets.size())))
+            return false;
+
+        keyframes.push_back(kf);
+    }
+
+    return true;
+}
+
+keyframe_indexer::keyframe_indexer(keyframe_index& index) :
+    m_index(index),
+    m_units(false),
+    m_unit_offset(0),
+    m_unit_pts(KEYFRAME_INDEX_NO_PTS),
+    m_zeros(0),
+    m_in_nal_unit(false),
+    m_nal_unit_offset(0),
+    m_nal_unit_pts(KEYFRAME_INDEX_NO_PTS),
+    m_nal_unit_limit(0),
+    m_nal_unit(),
+    m_vcl_seen(true), /* beginning of the stream starts new access unit */
+    m_au_pending(false),
+    m_au_offset(0),
+    m_au_pts(KEYFRAME_INDEX_NO_PTS),
+    m_keyframe_open(false)
+{
+    std::fill(std::begin(m_sps), std::end(m_sps), KEYFRAME_INDEX_NO_PARAMETER_SET);
+    std::fill(std::begin(m_pps), std::end(m_pps), KEYFRAME_INDEX_NO_PARAMETER_SET);
+    std::fill(std::begin(m_pps_sps_id), std::end(m_pps_sps_id), 0);
+
+    m_nal_unit.reserve(KEYFRAME_INDEX_MAX_PARAMETER_SET_SIZE);
+}
+
+keyframe_indexer::~keyframe_indexer()
+{
+}
+
+void keyframe_indexer::unit_start(uint64_t offset, uint64_t pts)
+{
+    m_units = true;
+    m_unit_offset = offset;
+    m_unit_pts = pts;
+}
+
+void keyframe_indexer::feed(const uint8_t* data, std::size_t count, uint64_t offset)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const uint8_t byte = data[i];
+
+        if ((m_zeros >= 2) && (0x01 == byte)) {
+            /* start code prefix (0x000001) */
+            if (m_in_nal_unit)
+                nal_unit_end();
+            nal_unit_start(m_units ? m_unit_offset : offset + i - std::min<uint32_t>(m_zeros, 3));
+            m_zeros = 0;
+            continue;
+        }
+
+        m_zeros = (0x00 == byte) ? m_zeros + 1 : 0;
+
+        if (m_in_nal_unit) {
+            if (m_nal_unit.empty()) {
+                /* nal unit header decides how much of the nal unit is needed */
+                switch (static_cast<nal_unit_type_e>(byte & 0x1f)) {
+                    case nal_unit_type_e::SPS:
+                    case nal_unit_type_e::PPS:
+                        m_nal_unit_limit = KEYFRAME_INDEX_MAX_PARAMETER_SET_SIZE;
+                        break;
+
+                    case nal_unit_type_e::CODED_SLICE_NON_IDR_PICTURE:
+                    case nal_unit_type_e::CODED_SLICE_IDR_PICTURE:
+                        m_nal_unit_limit = KEYFRAME_INDEXER_SLICE_HEADER_SIZE;
+                        break;
+
+                    default:
+                        m_nal_unit_limit = 1;
+                        break;
+                }
+            }
+
+            if (m_nal_unit.size() < m_nal_unit_limit)
+                m_nal_unit.push_back(byte);
+        }
+    }
+}
+
+void keyframe_indexer::finish(uint64_t end_offset)
+{
+    if (m_in_nal_unit)
+        nal_unit_end();
+
+    if (m_keyframe_open) {
+        keyframe_index::keyframe& kf = m_index.keyframes.back();
+        kf.size = end_offset - kf.offset;
+        m_keyframe_open = false;
+    }
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+void keyframe_indexer::nal_unit_start(uint64_t offset)
+{
+    m_in_nal_unit = true;
+    m_nal_unit_offset = offset;
+    m_nal_unit_pts = m_unit_pts;
+    m_nal_unit_limit = 1;
+    m_nal_unit.clear();
+}
+
+void keyframe_indexer::nal_unit_end()
+{
+    uint8_t rbsp[KEYFRAME_INDEX_MAX_PARAMETER_SET_SIZE];
+    uint32_t nal_unit_type;
+    int rbsp_size;
+
+    m_in_nal_unit = false;
+
+    /* zeros preceding next start code do not belong to this nal unit */
+    while (!m_nal_unit.empty() && (0x00 == m_nal_unit.back()))
+        m_nal_unit.pop_back();
+
+    if (m_nal_unit.empty())
+        return;
+
+    nal_unit_type = m_nal_unit[0] & 0x1f;
+
+    rbsp_size = h264_parser_nal_to_rbsp(rbsp, sizeof(rbsp), m_nal_unit.data() + 1, m_nal_unit.size() - 1);
+    istream_be s(rbsp, (rbsp_size > 0) ? rbsp_size : 0);
+
+    switch (static_cast<nal_unit_type_e>(nal_unit_type)) {
+        case nal_unit_type_e::SEI:
+        case nal_unit_type_e::AUD:
+        case nal_unit_type_e::PREFIX_NAL_UNIT:
+        case nal_unit_type_e::SPS_SUBSET:
+        case nal_unit_type_e::RESERVED1:
+        case nal_unit_type_e::RESERVED2:
+        case nal_unit_type_e::RESERVED3:
+            access_unit_start(m_nal_unit_offset, m_nal_unit_pts);
+            break;
+
+        case nal_unit_type_e::SPS:
+        {
+            uint32_t profile_and_level, id;
+
+            access_unit_start(m_nal_unit_offset, m_nal_unit_pts);
+
+            /* profile_idc, constraint_set_flags and level_idc precede seq_parameter_set_id */
+            if (s.read_bits(24, profile_and_level) && s.read_exp_golomb_u(id) &&
+                (id < H264_PARSER_MAX_NUMBER_OF_SPS))
+                m_sps[id] = add_parameter_set(nal_unit_type, id);
+            break;
+        }
+
+        case nal_unit_type_e::PPS:
+        {
+            uint32_t id, sps_id;
+
+            access_unit_start(m_nal_unit_offset, m_nal_unit_pts);
+
+            if (s.read_exp_golomb_u(id) && s.read_exp_golomb_u(sps_id) &&
+                (id < H264_PARSER_MAX_NUMBER_OF_PPS) && (sps_id < H264_PARSER_MAX_NUMBER_OF_SPS)) {
+                m_pps[id] = add_parameter_set(nal_unit_type, id);
+                m_pps_sps_id[id] = sps_id;
+            }
+            break;
+        }
+
+        case nal_unit_type_e::CODED_SLICE_NON_IDR_PICTURE:
+        case nal_unit_type_e::CODED_SLICE_IDR_PICTURE:
+        {
+            uint32_t first_mb_in_slice, slice_type, pps_id;
+            bool keyframe;
+
+            if (!s.read_exp_golomb_u(first_mb_in_slice) ||
+                !s.read_exp_golomb_u(slice_type) ||
+                !s.read_exp_golomb_u(pps_id) ||
+                (pps_id >= H264_PARSER_MAX_NUMBER_OF_PPS))
+                break;
+
+            if (first_mb_in_slice != 0) {
+                /* next slice of the same picture */
+                m_vcl_seen = true;
+                break;
+            }
+
+            /* first slice of a new picture - unless preceded by other nal units,
+               it is also the first nal unit of a new access unit */
+            if (!m_au_pending) {
+                m_au_offset = m_nal_unit_offset;
+                m_au_pts = m_nal_unit_pts;
+            }
+            m_au_pending = false;
+            m_vcl_seen = true;
+
+            if (m_keyframe_open) {
+                keyframe_index::keyframe& kf = m_index.keyframes.back();
+                if (m_au_offset <= kf.offset)
+                    break; /* both access units start within the same unit (PES packet) */
+                kf.size = m_au_offset - kf.offset;
+                m_keyframe_open = false;
+            }
+
+            keyframe = (nal_unit_type_e::CODED_SLICE_IDR_PICTURE == static_cast<nal_unit_type_e>(nal_unit_type)) ||
+                (h264::slice_type_e::I  == static_cast<h264::slice_type_e>(slice_type % 5)) ||
+                (h264::slice_type_e::SI == static_cast<h264::slice_type_e>(slice_type % 5));
+
+            if (keyframe) {
+                keyframe_index::keyframe kf;
+
+                kf.offset = m_au_offset;
+                kf.size = 0;
+                kf.pts = m_au_pts;
+                kf.nal_unit_type = nal_unit_type;
+                kf.pps = m_pps[pps_id];
+                kf.sps = (kf.pps != KEYFRAME_INDEX_NO_PARAMETER_SET) ?
+                    m_sps[m_pps_sps_id[pps_id]] : KEYFRAME_INDEX_NO_PARAMETER_SET;
+
+                m_index.keyframes.push_back(kf);
+                m_keyframe_open = true;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void keyframe_indexer::access_unit_start(uint64_t offset, uint64_t pts)
+{
+    /* only the first of nal units preceding first slice of the picture counts */
+    if (m_vcl_seen) {
+        m_vcl_seen = false;
+        m_au_pending = true;
+        m_au_offset = offset;
+        m_au_pts = pts;
+    }
+}
+
+uint32_t keyframe_indexer::add_parameter_set(uint32_t nal_unit_type, uint32_t id)
+{
+    const uint32_t current = (static_cast<nal_unit_type_e>(nal_unit_type) == nal_unit_type_e::SPS) ? m_sps[id] : m_pps[id];
+    keyframe_index::parameter_set ps;
+
+    /* parameter sets are usually repeated before every IDR picture - store them once */
+    if ((current != KEYFRAME_INDEX_NO_PARAMETER_SET) && (m_index.parameter_sets[current].nal_unit == m_nal_unit))
+        return current;
+
+    ps.nal_unit_type = nal_unit_type;
+    ps.id = id;
+    ps.offset = m_nal_unit_offset;
+    ps.nal_unit = m_nal_unit;
+
+    m_index.parameter_sets.push_back(std::move(ps));
+
+    return m_index.parameter_sets.size() - 1;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
@@ -0,0 +1,253 @@
+/**
+ * @file keyframe_index.hpp
+ *
+ * Definition of keyframe index (and of its builder).
+ *
+ * Index records byte ranges of all access units which can be decoded
+ * on their own (IDR pictures and pictures starting with I/SI slice),
+ * together with the parameter sets they depend on and (for transport
+ * streams) PTS of the PES packet carrying them. It is stored next to
+ * the indexed file (sidecar), so that subsequent runs can seek directly
+ * to the requested key frames instead of scanning the whole file.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _KEYFRAME_INDEX_HPP_
+#define _KEYFRAME_INDEX_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "h264_parser.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define KEYFRAME_INDEX_SUFFIX                 ".h264idx"
+#define KEYFRAME_INDEX_VERSION                2
+#define KEYFRAME_INDEX_NO_PTS                 UINT64_MAX
+#define KEYFRAME_INDEX_NO_PARAMETER_SET       UINT32_MAX
+
+/* parameter sets are stored in the index, so their size is limited */
+#define KEYFRAME_INDEX_MAX_PARAMETER_SET_SIZE 4096
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+struct keyframe_index
+{
+    struct parameter_set
+    {
+        uint32_t nal_unit_type; /* SPS or PPS */
+        uint32_t id;            /* seq_parameter_set_id or pic_parameter_set_id */
+        uint64_t offset;        /* where it has been found (see keyframe::offset) */
+        std::vector<uint8_t> nal_unit;
+    };
+
+    struct keyframe
+    {
+        uint64_t offset;        /* first byte of the access unit (annex b)
+                                   or first byte of the ts packet starting PES packet carrying it (ts) */
+        uint64_t size;          /* number of bytes to be fed to decode the access unit */
+        uint64_t pts;           /* KEYFRAME_INDEX_NO_PTS if not known */
+        uint32_t nal_unit_type; /* of the first slice */
+        uint32_t sps;           /* index in parameter_sets or KEYFRAME_INDEX_NO_PARAMETER_SET */
+        uint32_t pps;           /* index in parameter_sets or KEYFRAME_INDEX_NO_PARAMETER_SET */
+    };
+
+    explicit keyframe_index() :
+        ts(false),
+        pid(0),
+        tspacket_size(0),
+        file_size(0),
+        parameter_sets(),
+        keyframes()
+    {
+    }
+
+    void reset()
+    {
+        ts = false;
+        pid = 0;
+        tspacket_size = 0;
+        file_size = 0;
+        parameter_sets.clear();
+        keyframes.clear();
+    }
+
+    /**
+     * Stores the index in a binary file.
+     *
+     * @return true on success, false otherwise.
+     */
+    bool save(const char* filename) const;
+
+    /**
+     * Loads the index from a binary file created by save().
+     *
+     * @return true on success, false if file cannot be read or is malformed.
+     */
+    bool load(const char* filename);
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "keyframe_index@";
+        stream << std::hex << this;
+        stream << " [ts: ";
+        stream << (ts ? "y" : "n");
+        stream << ", pid: ";
+        stream << std::dec << pid;
+        stream << ", tspacket_size: ";
+        stream << std::dec << tspacket_size;
+        stream << ", file_size: ";
+        stream << std::dec << file_size;
+        stream << ", parameter sets: ";
+        stream << std::dec << parameter_sets.size();
+        stream << ", keyframes: ";
+        stream << std::dec << keyframes.size();
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+    bool ts;
+    uint32_t pid;
+    uint32_t tspacket_size; /* 188, 192 (m2ts), 204 or 208 (ts only) */
+    uint64_t file_size;
+    std::vector<parameter_set> parameter_sets;
+    std::vector<keyframe> keyframes;
+};
+
+/**
+ * Builds keyframe index from annex b byte stream in one pass,
+ * without decoding it. For transport streams, caller demultiplexes
+ * the stream and marks beginnings of PES packets with unit_start().
+ */
+class keyframe_indexer
+{
+public:
+    explicit keyframe_indexer(keyframe_index& index);
+    ~keyframe_indexer();
+
+    keyframe_indexer(const keyframe_indexer&) = delete;
+    keyframe_indexer(keyframe_indexer&&) = delete;
+    keyframe_indexer& operator = (const keyframe_indexer&) = delete;
+    keyframe_indexer& operator = (keyframe_indexer&&) = delete;
+
+    /**
+     * Marks beginning of a unit (PES packet) which decoding can be started from.
+     * All NAL units starting within the unit are given its offset.
+     * When never called, every NAL unit is given offset of its start code.
+     *
+     * @param[in] offset File offset of the unit.
+     * @param[in] pts    PTS of the unit or KEYFRAME_INDEX_NO_PTS.
+     */
+    void unit_start(uint64_t offset, uint64_t pts);
+
+    /**
+     * Scans next portion of annex b byte stream.
+     *
+     * @param[in] data   Pointer to the data.
+     * @param[in] count  Number of bytes.
+     * @param[in] offset File offset of data[0] (meaningful for annex b files only).
+     */
+    void feed(const uint8_t* data, std::size_t count, uint64_t offset);
+
+    /**
+     * Completes the index at the end of the stream.
+     *
+     * @param[in] end_offset File offset just past the last byte of the stream.
+     */
+    void finish(uint64_t end_offset);
+
+private:
+    void nal_unit_start(uint64_t offset);
+    void nal_unit_end();
+    void access_unit_start(uint64_t offset, uint64_t pts);
+    uint32_t add_parameter_set(uint32_t nal_unit_type, uint32_t id);
+
+    keyframe_index& m_index;
+
+    bool m_units;
+    uint64_t m_unit_offset;
+    uint64_t m_unit_pts;
+
+    /* start code detection */
+    uint32_t m_zeros;
+
+    /* currently scanned NAL unit */
+    bool m_in_nal_unit;
+    uint64_t m_nal_unit_offset;
+    uint64_t m_nal_unit_pts;
+    std::size_t m_nal_unit_limit;
+    std::vector<uint8_t> m_nal_unit;
+
+    /* access unit detection */
+    bool m_vcl_seen;
+    bool m_au_pending;
+    uint64_t m_au_offset;
+    uint64_t m_au_pts;
+    bool m_keyframe_open;
+
+    /* most recent parameter sets (indexes in m_index.parameter_sets) */
+    uint32_t m_sps[H264_PARSER_MAX_NUMBER_OF_SPS];
+    uint32_t m_pps[H264_PARSER_MAX_NUMBER_OF_PPS];
+    uint32_t m_pps_sps_id[H264_PARSER_MAX_NUMBER_OF_PPS];
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _KEYFRAME_INDEX_HPP_ */
@@ -20,6 +20,15 @@
 \*===========================================================================*/
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <list>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include <cstdlib>
 #include <cassert>
@@ -27,6 +36,8 @@
 extern "C" {
     #include <unistd.h>
     #include <getopt.h>
+    #include <dirent.h>
+    #include <sys/stat.h>
 }
 
 /*===========================================================================*\
@@ -34,10 +45,19 @@ extern "C" {
 \*===========================================================================*/
 #include "utilities.hpp"
 #include "strtointeger.hpp"
+#include "mapped_file.hpp"
+#include "mp4_demuxer.hpp"
+#include "file_reader.hpp"
 #include "mpeg2ts_pid.hpp"
 #include "mpeg2ts_parser.hpp"
+#include "mpeg2ts_psi.hpp"
+#include "mpeg2ts_demux.hpp"
+#include "mpeg2ts_seeker.hpp"
+#include "rtp_parser.hpp"
+#include "rtp_depacketizer.hpp"
 #include "h264_parser.hpp"
 #include "h264_decoder.hpp"
+#include "keyframe_index.hpp"
 
 /*===========================================================================*\
  * 'using namespace' section
@@ -48,7 +68,14 @@ extern "C" {
 \*===========================================================================*/
 #define READ_BUFFER_SIZE                       (4 * 1024)
 #define TS_PARSER_BUFFER_SIZE                  (2 * READ_BUFFER_SIZE)
+#define TS_PARSER_BATCH_SIZE                   64
+#define RTP_PARSER_BUFFER_SIZE                 (2 * (RTP_FRAMING_HEADER_SIZE + RTP_MAX_PACKET_SIZE))
 #define H264_PARSER_BUFFER_SIZE                (4 * 1024 * 1024)
+#define MMAP_WINDOW_SIZE                       (8 * 1024 * 1024)
+#define ASYNC_READ_BLOCK_SIZE                  (1 * 1024 * 1024)
+#define ASYNC_READ_BLOCKS                      4
+#define PARALLEL_MAX_THREADS                   64
+#define BATCH_MAX_JOBS                         64
 
 /*===========================================================================*\
  * local type definitions
@@ -56,10 +83,67 @@ extern "C" {
 namespace
 {
 
+/* video elementary stream carried by ts packets of one pid */
+struct mpeg2ts_stream
+{
+    mpeg2ts_stream(uint16_t pid, ymn::h264_decoder* decoder, const ymn::mpeg2ts_demux::es_function& es) :
+        h264_decoder(decoder),
+        demux(pid, es, [decoder]() { decoder->discard(); })
+    {
+        demux.set_timestamp_function(
+            [decoder](uint64_t pts, uint64_t dts) {
+                decoder->set_timestamps(pts, dts);
+            });
+    }
+
+    ymn::h264_decoder* h264_decoder;
+    ymn::mpeg2ts_demux demux;
+};
+
 struct mpeg2ts_parser_user_data
 {
-    ymn::mpeg2ts_pid pid;
+    std::list<mpeg2ts_stream> streams;
+
+    /* stream which decoder has been logging recently (when there are more of them) */
+    const mpeg2ts_stream* logging_stream;
+    std::ostream* log;
+
+    /* discovers streams when pids are not given explicitly */
+    ymn::mpeg2ts_psi* psi;
+
+    /* applied to the discovered streams */
+    bool random_access_only;
+    bool intra_only;
+    std::size_t max_nal_size;
+    uint64_t start_time;
+};
+
+/* part of the stream which can be decoded independently of the others */
+struct decoding_range
+{
+    uint64_t offset;
+    uint64_t size;
+    std::vector<uint32_t> parameter_sets; /* active at the beginning of the range (indexes in
+                                             keyframe_index::parameter_sets, SPSs first) to be fed first */
+};
+
+struct encapsulation
+{
+    bool rtp;
+    bool ts;
+    bool annex_b;
+    bool mp4;
+};
+
+/* objects decoding one input (any number of pipelines may work in one process) */
+struct pipeline
+{
     ymn::h264_decoder* h264_decoder;
+    ymn::mpeg2ts_parser* mpeg2ts_parser;
+    mpeg2ts_parser_user_data mpeg2ts_user_data;
+    ymn::rtp_parser* rtp_parser;
+    ymn::rtp_depacketizer* rtp_depacketizer;
+    std::ofstream h264_ofile;
 };
 
 } // end of anonymous namespace
@@ -71,39 +155,120 @@ struct mpeg2ts_parser_user_data
 /*===========================================================================*\
  * local function declarations
 \*===========================================================================*/
-static void h264_decoder_feed(ymn::h264_decoder& decoder, const uint8_t* data, std::size_t count);
+static void h264_decoder_feed(ymn::h264_decoder& decoder, std::ofstream* ofile, const uint8_t* data, std::size_t count);
+static void h264_ofile_write_nal_unit(std::ofstream& ofile, const uint8_t* data, std::size_t count);
 
-static void mpeg2ts_parser_demux(ymn::mpeg2ts_parser& parser, const uint8_t *tspayload, std::size_t count, bool payload_unit_start_indicator);
-static void mpeg2ts_parser_handle_tspacket(ymn::mpeg2ts_parser& parser, const uint8_t *tspacket);
+static mpeg2ts_stream& mpeg2ts_parser_add_stream(mpeg2ts_parser_user_data& user_data, uint16_t pid, ymn::h264_decoder* decoder, std::ofstream* ofile);
+static void mpeg2ts_parser_select_stream(mpeg2ts_parser_user_data& user_data, const mpeg2ts_stream& stream);
+static void mpeg2ts_parser_flush(mpeg2ts_parser_user_data& user_data);
+static void mpeg2ts_parser_psi_event(mpeg2ts_parser_user_data& user_data, ymn::mpeg2ts_psi_event_e event, uint16_t program_number, uint16_t pid);
 
 static void mpeg2ts_parser_parse(ymn::mpeg2ts_parser& parser);
 static void mpeg2ts_parser_feed(ymn::mpeg2ts_parser& parser, const uint8_t* data, std::size_t count);
 
+static void rtp_depacketizer_deliver(pipeline& pipeline, const encapsulation& encapsulation, const uint8_t* data, std::size_t count);
+static void rtp_parser_parse(ymn::rtp_parser& parser, ymn::rtp_depacketizer& depacketizer);
+static void rtp_parser_feed(ymn::rtp_parser& parser, ymn::rtp_depacketizer& depacketizer, const uint8_t* data, std::size_t count);
+
+static void feed(pipeline& pipeline, const uint8_t* data, std::size_t count, const encapsulation& encapsulation);
+static std::size_t ifstream_feed(pipeline& pipeline, std::ifstream& file, const encapsulation& encapsulation);
+static void mapped_file_feed(pipeline& pipeline, const ymn::mapped_file& file, const encapsulation& encapsulation);
+static std::size_t file_reader_feed(pipeline& pipeline, ymn::file_reader& reader, const encapsulation& encapsulation);
+static std::size_t mp4_feed(pipeline& pipeline, const ymn::mapped_file& file);
+
+static bool pids_parse(const char* list, std::vector<uint16_t>& pids);
+static bool time_parse(const char* str, uint64_t& time);
+static bool keyframes_parse(const char* list, std::size_t number_of_keyframes, std::vector<std::size_t>& keyframes);
+static void keyframe_index_build(const ymn::mapped_file& file, const encapsulation& encapsulation, uint16_t pid, ymn::keyframe_index& index);
+static std::size_t keyframe_index_feed(pipeline& pipeline, const ymn::mapped_file& file, const ymn::keyframe_index& index, const std::vector<std::size_t>& keyframes);
+
+static std::size_t parallel_feed(const ymn::mapped_file& file, const encapsulation& encapsulation, uint16_t pid, bool intra_only, std::size_t max_nal_size, unsigned int threads);
+
+static bool seek_times_parse(const char* list, std::vector<uint64_t>& times, uint64_t& step);
+static std::size_t seek_feed(pipeline& pipeline, const ymn::mapped_file& file, uint16_t pid, const std::vector<uint64_t>& times, uint64_t step);
+
+static bool batch_add_input(const std::string& name, std::vector<std::string>& filenames);
+static std::size_t batch_feed(const std::vector<std::string>& filenames, const encapsulation& encapsulation, uint16_t pid, bool random_access_only, bool intra_only, std::size_t max_nal_size, unsigned int jobs);
+
 /*===========================================================================*\
  * local object definitions
 \*===========================================================================*/
-static ymn::h264_decoder* h264_decoder = nullptr;
-static ymn::mpeg2ts_parser* mpeg2ts_parser = nullptr;
-static std::ofstream h264_ofile;
 
 /*===========================================================================*\
  * inline function definitions
 \*===========================================================================*/
 static inline void h264iframedecoder_usage(const char* progname)
 {
-    std::cout << "usage: " << progname << " [-r] [-t pid] [-a] [-o ofile] <filename>" << std::endl;
+    std::cout << "usage: " << progname << " [-r] [-t pid[,pid...] | -t auto] [-R] [-I] [-T time] [-a | -l size | -i] [-m | -A [-D]] [-b | -x [-k list] | -S list | -P n] [-o ofile] <filename>" << std::endl;
+    std::cout << "       " << progname << " [-t pid | -a] [-I] -j n <filename | directory | -> ..." << std::endl;
     std::cout << " options: " << std::endl;
     std::cout << "  -r --rtp                : Specifies that input h264 stream is additionally encapsulated by" << std::endl;
     std::cout << "                          : RTP Payload Format for H.264 Video (RFC 6184)." << std::endl;
+    std::cout << "                          : Every rtp packet shall be preceded by 16 bit length field (RFC 4571)." << std::endl;
     std::cout << "                          : When used together with -t, then set of ts packets is encapsulated by just one" << std::endl;
     std::cout << "                          : rtp fixed header (RFC 3550 A Transport Protocol for Real-Time Applications)." << std::endl;
     std::cout << std::endl;
     std::cout << "  -t pid --ts=pid         : Specifies that input h264 stream is encapsulated by ISO/IEC 13818-1 transport stream." << std::endl;
     std::cout << "                          : Then pid value shall specify ts packets carrying desired video stream." << std::endl;
+    std::cout << "                          : Comma separated list of pids selects more streams, each decoded by its own" << std::endl;
+    std::cout << "                          : decoder in the same pass (-o, -b, -x, -P and -j accept one pid only)." << std::endl;
+    std::cout << "                          : 'auto' decodes every H.264 stream announced by PAT/PMT tables." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -R --random-access      : Together with -t, passes to the decoder only PES packets starting" << std::endl;
+    std::cout << "                          : in ts packets with random_access_indicator or elementary_stream_priority_indicator" << std::endl;
+    std::cout << "                          : set (once the stream has signalled one), so other pictures are not even parsed." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -I --intra-only         : Drops P and B slices as soon as their slice_type is read, before" << std::endl;
+    std::cout << "                          : their headers are parsed (they are never decoded anyway)." << std::endl;
+    std::cout << "                          : Only NAL unit type and size of such slices are logged." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -N n --max-nal-size=n   : Largest NAL unit (in MiB, default " << (H264_DECODER_MAX_BUFFER_SIZE >> 20) << ") the parser's buffer may grow to hold," << std::endl;
+    std::cout << "                          : when stream is not memory mapped (see -m). Bigger ones are dropped." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -T time --time=time     : Together with -t, decodes only pictures presented at or after given time" << std::endl;
+    std::cout << "                          : ([[hh:]mm:]ss[.fff]) counted from the first picture of the stream" << std::endl;
+    std::cout << "                          : (according to PTS of PES packets). Together with -x, key frames" << std::endl;
+    std::cout << "                          : presented before that time are not even read. Every decoded picture" << std::endl;
+    std::cout << "                          : is labelled with its presentation time also without this option." << std::endl;
     std::cout << std::endl;
     std::cout << "  -a --annex-b            : Specifies that input h264 stream is encapsulated by ISO/IEC 14496-10 Annex B." << std::endl;
     std::cout << "                          : When -t is used this option will be selected automatically." << std::endl;
     std::cout << std::endl;
+    std::cout << "  -l size                 : Specifies that every NAL unit of input h264 stream is preceded" << std::endl;
+    std::cout << "  --length-prefixed=size  : by its length (AVCC, ISO/IEC 14496-15) coded on 'size' (1, 2 or 4) bytes." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -i --mp4                : Input file is ISO/IEC 14496-12 (MP4) file. Only sync samples (key frames)" << std::endl;
+    std::cout << "                          : of the first avc video track are read. Implies -m." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -m --mmap               : Input file is memory mapped and parsed in place (without copying)." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -A --async              : Input file is read by separate thread in large blocks," << std::endl;
+    std::cout << "                          : which overlaps disk reads with parsing." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -D --direct             : Together with -A, input file is read with O_DIRECT (bypassing page cache)." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -b --build-index        : Scans annex b (-a) or transport (-t) stream once, without decoding it," << std::endl;
+    std::cout << "                          : and stores offsets of all key frames in '<filename>" KEYFRAME_INDEX_SUFFIX "'. Implies -m." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -x --index              : Decodes only key frames found in '<filename>" KEYFRAME_INDEX_SUFFIX "' (see -b)." << std::endl;
+    std::cout << "                          : Encapsulation and pid are taken from the index. Implies -m." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -k list --keyframes=list: Together with -x, decodes only listed key frames (e.g. 0,3,10-20)." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -S list --seek=list     : Together with -t, decodes key frames presented at (or first after) listed times" << std::endl;
+    std::cout << "                          : (e.g. 10,1:00,1:00:00.5) or every given interval ('/10' - one key frame per" << std::endl;
+    std::cout << "                          : 10 seconds). Key frames are located by PCR based estimation and bisection," << std::endl;
+    std::cout << "                          : so only small parts of the file are read. Implies -m." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -P n --parallel=n       : Splits annex b (-a) or transport (-t) stream at IDR pictures and decodes" << std::endl;
+    std::cout << "                          : the parts by n threads (0 - one per cpu). Output keeps file order." << std::endl;
+    std::cout << "                          : Implies -m. Cannot be used with -o." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -j n --jobs=n           : Batch mode. Decodes all given files (directory stands for the files it contains," << std::endl;
+    std::cout << "                          : '-' for the list of files read from stdin, one per line) by n workers" << std::endl;
+    std::cout << "                          : (0 - one per cpu), each reusing its decoder for consecutive files." << std::endl;
+    std::cout << "                          : Annex b (-a) or transport (-t) streams only. Implies -m. Cannot be used with -o." << std::endl;
+    std::cout << std::endl;
     std::cout << "  -o ofile --output=ofile : When this option is provided, then selected h264 stream" << std::endl;
     std::cout << "                          : will additionally be stored in file depicted by ofile." << std::endl;
 }
@@ -114,26 +279,62 @@ static inline void h264iframedecoder_usage(const char* progname)
 int main(int argc, char *argv[])
 {
     bool status;
-    struct {
-        bool rtp;
-        bool ts;
-        bool annex_b;
-    } encapsulation = {};
+    encapsulation encapsulation = {};
+    bool mmap = false;
+    bool async = false;
+    bool direct = false;
+    bool build_index = false;
+    bool use_index = false;
+    const char* keyframes = nullptr;
+    unsigned int threads = 0;
+    bool parallel = false;
+    unsigned int jobs = 0;
+    bool batch = false;
     uint16_t pid = MPEG2TS_PID_INVALID;
+    std::vector<uint16_t> pids;
+    bool auto_pids = false;
+    bool random_access_only = false;
+    bool intra_only = false;
+    std::size_t max_nal_size = H264_DECODER_MAX_BUFFER_SIZE;
+    unsigned int max_nal_size_mib;
+    uint64_t start_time = 0;
+    bool start_time_given = false;
+    bool length_prefixed = false;
+    uint32_t nal_length_size = H264_PARSER_DEFAULT_NAL_LENGTH_SIZE;
     const char* ofile = nullptr;
     ymn::h264_parser_container_e container = ymn::h264_parser_container_e::NONE;
-    mpeg2ts_parser_user_data mpeg2ts_user_data;
+    pipeline pipeline = {};
+    ymn::keyframe_index index;
+    std::vector<std::size_t> selected_keyframes;
+    bool seek = false;
+    std::vector<uint64_t> seek_times;
+    uint64_t seek_step = 0;
 
     static struct option long_options[] = {
-        {"rtp",     no_argument,       0, 'r'},
-        {"ts",      required_argument, 0, 't'},
-        {"annex-b", no_argument,       0, 'a'},
-        {"ofile",   required_argument, 0, 'o'},
-        {0,         0,                 0,  0 }
+        {"rtp",             no_argument,       0, 'r'},
+        {"ts",              required_argument, 0, 't'},
+        {"random-access",   no_argument,       0, 'R'},
+        {"intra-only",      no_argument,       0, 'I'},
+        {"max-nal-size",    required_argument, 0, 'N'},
+        {"time",            required_argument, 0, 'T'},
+        {"annex-b",         no_argument,       0, 'a'},
+        {"length-prefixed", required_argument, 0, 'l'},
+        {"mp4",             no_argument,       0, 'i'},
+        {"mmap",            no_argument,       0, 'm'},
+        {"async",           no_argument,       0, 'A'},
+        {"direct",          no_argument,       0, 'D'},
+        {"build-index",     no_argument,       0, 'b'},
+        {"index",           no_argument,       0, 'x'},
+        {"keyframes",       required_argument, 0, 'k'},
+        {"seek",            required_argument, 0, 'S'},
+        {"parallel",        required_argument, 0, 'P'},
+        {"jobs",            required_argument, 0, 'j'},
+        {"ofile",           required_argument, 0, 'o'},
+        {0,                 0,                 0,  0 }
     };
 
     for (;;) {
-        int c = getopt_long(argc, argv, "rt:ao:", long_options, 0);
+        int c = getopt_long(argc, argv, "rt:RIN:T:al:imADbxk:S:P:j:o:", long_options, 0);
         if (-1 == c)
             break;
 
@@ -146,12 +347,42 @@ int main(int argc, char *argv[])
                 encapsulation.ts = true;
                 encapsulation.annex_b = true;
                 container = ymn::h264_parser_container_e::ANNEX_B;
-                status = (ymn::strtointeger_conversion_status_e::success == ymn::strtointeger(optarg, pid));
+                auto_pids = (0 == strcmp(optarg, "auto"));
+                status = auto_pids || pids_parse(optarg, pids);
                 if (!status) {
-                    std::cerr << "error: cannot convert '" << optarg << "' to integer" << std::endl;
+                    std::cerr << "error: cannot convert '" << optarg << "' to list of pids" << std::endl;
+                    h264iframedecoder_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                if (!auto_pids)
+                    pid = pids.front();
+                break;
+
+            case 'R':
+                random_access_only = true;
+                break;
+
+            case 'I':
+                intra_only = true;
+                break;
+
+            case 'N':
+                status = (ymn::strtointeger_conversion_status_e::success == ymn::strtointeger(optarg, max_nal_size_mib));
+                if (!status || (0 == max_nal_size_mib)) {
+                    std::cerr << "error: cannot convert '" << optarg << "' to size" << std::endl;
                     h264iframedecoder_usage(argv[0]);
                     exit(EXIT_FAILURE);
                 }
+                max_nal_size = static_cast<std::size_t>(max_nal_size_mib) << 20;
+                break;
+
+            case 'T':
+                if (!time_parse(optarg, start_time)) {
+                    std::cerr << "error: cannot convert '" << optarg << "' to time" << std::endl;
+                    h264iframedecoder_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                start_time_given = true;
                 break;
 
             case 'a':
@@ -159,6 +390,88 @@ int main(int argc, char *argv[])
                 container = ymn::h264_parser_container_e::ANNEX_B;
                 break;
 
+            case 'l':
+                length_prefixed = true;
+                container = ymn::h264_parser_container_e::AVCC;
+                status = (ymn::strtointeger_conversion_status_e::success == ymn::strtointeger(optarg, nal_length_size));
+                if (!status) {
+                    std::cerr << "error: cannot convert '" << optarg << "' to integer" << std::endl;
+                    h264iframedecoder_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'i':
+                encapsulation.mp4 = true;
+                container = ymn::h264_parser_container_e::AVCC;
+                mmap = true;
+                break;
+
+            case 'm':
+                mmap = true;
+                break;
+
+            case 'A':
+                async = true;
+                break;
+
+            case 'D':
+                async = true;
+                direct = true;
+                break;
+
+            case 'b':
+                build_index = true;
+                mmap = true;
+                break;
+
+            case 'x':
+                use_index = true;
+                mmap = true;
+                break;
+
+            case 'k':
+                keyframes = optarg;
+                break;
+
+            case 'S':
+                if (!seek_times_parse(optarg, seek_times, seek_step)) {
+                    std::cerr << "error: cannot convert '" << optarg << "' to list of times" << std::endl;
+                    h264iframedecoder_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                seek = true;
+                mmap = true;
+                break;
+
+            case 'P':
+                parallel = true;
+                mmap = true;
+                status = (ymn::strtointeger_conversion_status_e::success == ymn::strtointeger(optarg, threads));
+                if (!status) {
+                    std::cerr << "error: cannot convert '" << optarg << "' to integer" << std::endl;
+                    h264iframedecoder_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                if (0 == threads)
+                    threads = std::max(1U, std::thread::hardware_concurrency());
+                threads = std::min(threads, static_cast<unsigned int>(PARALLEL_MAX_THREADS));
+                break;
+
+            case 'j':
+                batch = true;
+                mmap = true;
+                status = (ymn::strtointeger_conversion_status_e::success == ymn::strtointeger(optarg, jobs));
+                if (!status) {
+                    std::cerr << "error: cannot convert '" << optarg << "' to integer" << std::endl;
+                    h264iframedecoder_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                if (0 == jobs)
+                    jobs = std::max(1U, std::thread::hardware_concurrency());
+                jobs = std::min(jobs, static_cast<unsigned int>(BATCH_MAX_JOBS));
+                break;
+
             case 'o':
                 ofile = optarg;
                 break;
@@ -170,84 +483,325 @@ int main(int argc, char *argv[])
         }
     }
 
+    const char* filename = argv[optind];
+    if (!filename) {
+         std::cerr << "error: missing input file" << std::endl;
+         h264iframedecoder_usage(argv[0]);
+         exit(EXIT_FAILURE);
+    }
+
+    if (length_prefixed && (encapsulation.annex_b || use_index)) {
+        std::cerr << "error: -l excludes -a, -t and -x" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (encapsulation.mp4 && (encapsulation.rtp || encapsulation.annex_b || length_prefixed ||
+                              random_access_only || start_time_given || seek)) {
+        std::cerr << "error: -i excludes -r, -t, -a, -l, -R, -T and -S" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (random_access_only && (!encapsulation.ts || build_index || use_index || parallel)) {
+        std::cerr << "error: -R requires transport stream (-t) and excludes -b, -x and -P" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (start_time_given && ((!encapsulation.ts && !use_index) || build_index || parallel || batch)) {
+        std::cerr << "error: -T requires transport stream (-t or -x) and excludes -b, -P and -j" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (seek && (!encapsulation.ts || encapsulation.rtp || auto_pids || (pids.size() > 1) ||
+                 random_access_only || start_time_given || build_index || use_index || parallel || batch)) {
+        std::cerr << "error: -S requires transport stream (-t) of one pid and excludes -R, -T, -b, -x, -P and -j" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((build_index || use_index) && (encapsulation.rtp || encapsulation.mp4)) {
+        std::cerr << "error: key frame index cannot be used with rtp or mp4 input" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (build_index && !encapsulation.annex_b) {
+        std::cerr << "error: key frame index can be built for annex b (-a) or transport (-t) streams only" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (parallel && (encapsulation.rtp || encapsulation.mp4 || !encapsulation.annex_b ||
+                     build_index || use_index || (ofile != nullptr))) {
+        std::cerr << "error: parallel decoding requires annex b (-a) or transport (-t) stream and excludes -b, -x and -o" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((auto_pids || (pids.size() > 1)) && (build_index || use_index || parallel || batch || (ofile != nullptr))) {
+        std::cerr << "error: more than one pid (or 'auto') cannot be used with -b, -x, -P, -j or -o" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch && (encapsulation.rtp || encapsulation.mp4 || !encapsulation.annex_b ||
+                  build_index || use_index || parallel || (ofile != nullptr))) {
+        std::cerr << "error: batch mode requires annex b (-a) or transport (-t) streams and excludes -b, -x, -P and -o" << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch) {
+        std::vector<std::string> filenames;
+
+        for (int i = optind; i < argc; ++i) {
+            if (!batch_add_input(argv[i], filenames)) {
+                std::cerr << "error: could not read '" << argv[i] << "'" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        const std::size_t read_bytes = batch_feed(filenames, encapsulation, pid, random_access_only, intra_only, max_nal_size, jobs);
+        std::cout << "mapped " << read_bytes << " bytes from " << filenames.size() << " files" << std::endl;
+
+        return 0;
+    }
+
+    if (use_index) {
+        const std::string index_filename = std::string(filename) + KEYFRAME_INDEX_SUFFIX;
+        if (!index.load(index_filename.c_str())) {
+            std::cerr << "error: could not load key frame index '" << index_filename << "'" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (!keyframes_parse(keyframes, index.keyframes.size(), selected_keyframes)) {
+            std::cerr << "error: invalid list of key frames '" << keyframes << "'" << std::endl;
+            h264iframedecoder_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        if (start_time_given) {
+            if (!index.ts) {
+                std::cerr << "error: -T requires index of transport stream" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            /* key frames before the requested time are not even read */
+            const uint64_t origin = index.keyframes.empty() ? 0 : index.keyframes.front().pts;
+            selected_keyframes.erase(
+                std::remove_if(selected_keyframes.begin(), selected_keyframes.end(),
+                    [&](std::size_t i) {
+                        const uint64_t pts = index.keyframes[i].pts;
+                        return (KEYFRAME_INDEX_NO_PTS == pts) ||
+                            (((pts - origin) & H264_DECODER_TIMESTAMP_MASK) < start_time);
+                    }),
+                selected_keyframes.end());
+        }
+        encapsulation.ts = index.ts;
+        encapsulation.annex_b = true;
+        container = ymn::h264_parser_container_e::ANNEX_B;
+        pid = index.pid;
+        pids.assign(1, pid);
+        auto_pids = false;
+    }
+
     std::cout << "encapsulation:"
         << " rtp=" << (encapsulation.rtp ? "y" : "n")
         << " ts=" << (encapsulation.ts ? "y" : "n")
         << " annex-b=" << (encapsulation.annex_b ? "y" : "n")
+        << " mp4=" << (encapsulation.mp4 ? "y" : "n")
         << std::endl;
+    if (encapsulation.ts && auto_pids)
+        std::cout << "pid: auto" << std::endl;
+    else
     if (encapsulation.ts)
-        std::cout << "pid: " << HEXDEC(pid) << std::endl;
+        for (const auto p : pids)
+            std::cout << "pid: " << HEXDEC(p) << std::endl;
     std::cout << "container: " << to_string(container) << std::endl;
 
-    const char* filename = argv[optind];
-    if (!filename) {
-         std::cerr << "error: missing input file" << std::endl;
-         h264iframedecoder_usage(argv[0]);
-         exit(EXIT_FAILURE);
-    }
-
    if (ofile != nullptr) {
-      h264_ofile = std::ofstream(ofile, std::ios::out | std::ios::binary);
-      if (!h264_ofile.is_open()) {
+      pipeline.h264_ofile = std::ofstream(ofile, std::ios::out | std::ios::binary);
+      if (!pipeline.h264_ofile.is_open()) {
          std::cerr << "error: could not open '" << ofile << "'" << std::endl;
          h264iframedecoder_usage(argv[0]);
          exit(EXIT_FAILURE);
       }
    }
 
-    h264_decoder = new ymn::h264_decoder(container);
-    assert(h264_decoder != nullptr);
+    pipeline.h264_decoder = new ymn::h264_decoder(container);
+    assert(pipeline.h264_decoder != nullptr);
+
+    pipeline.h264_decoder->set_intra_only(intra_only);
+    pipeline.h264_decoder->set_max_buffer_size(max_nal_size);
+
+    if (!pipeline.h264_decoder->set_nal_length_size(nal_length_size)) {
+        std::cerr << "error: unsupported nal unit length size " << nal_length_size << std::endl;
+        h264iframedecoder_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* time of key frames is counted from the first one, even if it is not decoded */
+    if (use_index && !index.keyframes.empty() && (index.keyframes.front().pts != KEYFRAME_INDEX_NO_PTS))
+        pipeline.h264_decoder->set_time_origin(index.keyframes.front().pts);
 
     if (encapsulation.ts) {
-        mpeg2ts_parser = new ymn::mpeg2ts_parser(TS_PARSER_BUFFER_SIZE);
-        assert(mpeg2ts_parser != nullptr);
+        pipeline.mpeg2ts_parser = new ymn::mpeg2ts_parser(TS_PARSER_BUFFER_SIZE);
+        assert(pipeline.mpeg2ts_parser != nullptr);
+
+        pipeline.mpeg2ts_user_data.logging_stream = nullptr;
+        pipeline.mpeg2ts_user_data.log = &std::cout;
+        pipeline.mpeg2ts_user_data.psi = nullptr;
+        pipeline.mpeg2ts_user_data.random_access_only = random_access_only;
+        pipeline.mpeg2ts_user_data.intra_only = intra_only;
+        pipeline.mpeg2ts_user_data.max_nal_size = max_nal_size;
+        pipeline.mpeg2ts_user_data.start_time = start_time;
+
+        /* first stream uses the main decoder, every other one gets its own */
+        for (std::size_t i = 0; i < pids.size(); ++i) {
+            ymn::h264_decoder* decoder = (0 == i) ? pipeline.h264_decoder : new ymn::h264_decoder(container);
+            assert(decoder != nullptr);
+            mpeg2ts_parser_add_stream(pipeline.mpeg2ts_user_data, pids[i], decoder, &pipeline.h264_ofile);
+        }
 
-        mpeg2ts_user_data.pid = pid;
-        mpeg2ts_user_data.h264_decoder = h264_decoder;
+        if (auto_pids) {
+            pipeline.mpeg2ts_user_data.psi = new ymn::mpeg2ts_psi(
+                [&pipeline](ymn::mpeg2ts_psi_event_e event, uint16_t program_number, uint16_t pid) {
+                    mpeg2ts_parser_psi_event(pipeline.mpeg2ts_user_data, event, program_number, pid);
+                });
+            assert(pipeline.mpeg2ts_user_data.psi != nullptr);
+        }
+        else {
+            /* packets of other pids are dropped by the parser itself */
+            pipeline.mpeg2ts_parser->set_pid_filter(false);
+            for (const auto p : pids)
+                pipeline.mpeg2ts_parser->set_pid_filter(p, true);
+        }
 
-        mpeg2ts_parser->set_user_data(&mpeg2ts_user_data);
+        pipeline.mpeg2ts_parser->set_user_data(&pipeline.mpeg2ts_user_data);
     }
 
     if (encapsulation.rtp) {
+        pipeline.rtp_parser = new ymn::rtp_parser(RTP_PARSER_BUFFER_SIZE);
+        assert(pipeline.rtp_parser != nullptr);
+
+        pipeline.rtp_depacketizer = new ymn::rtp_depacketizer(
+            encapsulation.ts ? ymn::rtp_payload_format_e::MP2T : ymn::rtp_payload_format_e::H264,
+            [&pipeline, &encapsulation](const uint8_t* data, std::size_t count) {
+                rtp_depacketizer_deliver(pipeline, encapsulation, data, count);
+            });
+        assert(pipeline.rtp_depacketizer != nullptr);
     }
 
     std::size_t read_bytes = 0;
-    std::ifstream file(filename, std::ios::in | std::ios::binary);
-    if (file.is_open()) {
-        std::streamsize count;
-        char* memblock;
-
-        memblock = new char[READ_BUFFER_SIZE];
-
-        do {
-            count = file.readsome(memblock, READ_BUFFER_SIZE);
-            read_bytes += count;
-            if (count > 0) {
-                if (encapsulation.rtp)
-                    /* to be implemented */;
-                else
-                if (encapsulation.ts)
-                    mpeg2ts_parser_feed(*mpeg2ts_parser, reinterpret_cast<uint8_t*>(memblock), count);
-                else
-                    h264_decoder_feed(*h264_decoder, reinterpret_cast<uint8_t*>(memblock), count);
+    if (mmap) {
+        ymn::mapped_file file;
+        if (file.open(filename)) {
+            if (build_index) {
+                const std::string index_filename = std::string(filename) + KEYFRAME_INDEX_SUFFIX;
+                keyframe_index_build(file, encapsulation, pid, index);
+                std::cout << index.to_string() << std::endl;
+                if (!index.save(index_filename.c_str()))
+                    std::cerr << "error: could not write '" << index_filename << "'" << std::endl;
+                read_bytes = file.size();
+                std::cout << "indexed " << read_bytes << " bytes from '" << filename << "'" << std::endl;
             }
-        } while (count > 0);
-
-        file.close();
-        std::cout << "read " << read_bytes << " bytes from '" << filename << "'" << std::endl;
+            else
+            if (parallel) {
+                read_bytes = parallel_feed(file, encapsulation, pid, intra_only, max_nal_size, threads);
+                std::cout << "decoded " << read_bytes << " bytes from '" << filename << "'" << std::endl;
+            }
+            else
+            if (seek) {
+                read_bytes = seek_feed(pipeline, file, pid, seek_times, seek_step);
+                std::cout << "read " << read_bytes << " out of " << file.size() << " bytes from '" << filename << "'" << std::endl;
+            }
+            else
+            if (use_index) {
+                if (index.file_size != file.size()) {
+                    std::cerr << "error: '" << filename << "' has changed since it was indexed" << std::endl;
+                }
+                else {
+                    read_bytes = keyframe_index_feed(pipeline, file, index, selected_keyframes);
+                    std::cout << "read " << read_bytes << " out of " << file.size() << " bytes from '" << filename << "'" << std::endl;
+                }
+            }
+            else
+            if (encapsulation.mp4) {
+                read_bytes = mp4_feed(pipeline, file);
+                std::cout << "read " << read_bytes << " out of " << file.size() << " bytes from '" << filename << "'" << std::endl;
+            }
+            else {
+                mapped_file_feed(pipeline, file, encapsulation);
+                read_bytes = file.size();
+                std::cout << "mapped " << read_bytes << " bytes from '" << filename << "'" << std::endl;
+            }
+            file.close();
+        }
+        else {
+            std::cerr << "error: could not map '" << filename << "'" << std::endl;
+        }
+    }
+    else
+    if (async) {
+        ymn::file_reader reader(ASYNC_READ_BLOCK_SIZE, ASYNC_READ_BLOCKS, direct);
+        if (reader.open(filename)) {
+            read_bytes = file_reader_feed(pipeline, reader, encapsulation);
+            reader.close();
+            if (reader.has_failed())
+                std::cerr << "error: reading '" << filename << "' failed" << std::endl;
+            std::cout << "read " << read_bytes << " bytes from '" << filename << "'"
+                << (reader.is_direct() ? " (direct)" : "") << std::endl;
+        }
+        else {
+            std::cerr << "error: could not open '" << filename << "'" << std::endl;
+        }
     }
     else {
-        std::cerr << "error: could not open '" << filename << "'" << std::endl;
+        std::ifstream file(filename, std::ios::in | std::ios::binary);
+        if (file.is_open()) {
+            read_bytes = ifstream_feed(pipeline, file, encapsulation);
+            file.close();
+            std::cout << "read " << read_bytes << " bytes from '" << filename << "'" << std::endl;
+        }
+        else {
+            std::cerr << "error: could not open '" << filename << "'" << std::endl;
+        }
+    }
+
+    if (pipeline.rtp_depacketizer) {
+        /* deliver whatever is still waiting for missing packets */
+        pipeline.rtp_depacketizer->flush();
+        std::cout << pipeline.rtp_depacketizer->to_string() << std::endl;
+        delete pipeline.rtp_depacketizer;
     }
 
-    if (mpeg2ts_parser)
-        delete mpeg2ts_parser;
+    if (pipeline.rtp_parser)
+        delete pipeline.rtp_parser;
 
-    if (h264_decoder)
-        delete h264_decoder;
+    /* last NAL unit of annex b stream is terminated by the end of the stream */
+    if (pipeline.mpeg2ts_parser && !build_index)
+        mpeg2ts_parser_flush(pipeline.mpeg2ts_user_data);
+    else
+    if (pipeline.h264_decoder && !build_index)
+        pipeline.h264_decoder->flush();
 
-    if (h264_ofile.is_open())
-        h264_ofile.close();
+    if (pipeline.mpeg2ts_parser)
+        delete pipeline.mpeg2ts_parser;
+
+    for (auto& stream : pipeline.mpeg2ts_user_data.streams)
+        if (stream.h264_decoder != pipeline.h264_decoder)
+            delete stream.h264_decoder;
+
+    if (pipeline.mpeg2ts_user_data.psi) {
+        std::cout << pipeline.mpeg2ts_user_data.psi->to_string() << std::endl;
+        delete pipeline.mpeg2ts_user_data.psi;
+    }
+
+    if (pipeline.h264_decoder)
+        delete pipeline.h264_decoder;
+
+    if (pipeline.h264_ofile.is_open())
+        pipeline.h264_ofile.close();
 
     return 0;
 }
@@ -263,153 +817,56 @@ int main(int argc, char *argv[])
 /*===========================================================================*\
  * local function definitions
 \*===========================================================================*/
-static void h264_decoder_feed(ymn::h264_decoder& decoder, const uint8_t* data, std::size_t count)
+static void h264_decoder_feed(ymn::h264_decoder& decoder, std::ofstream* ofile, const uint8_t* data, std::size_t count)
 {
 //{
 //    const uint8_t *p = data;
 //    fprintf(stdout, " 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n", p[0], p[1], p[2], p[3], p[4], p[5], p[6]);
 //}
 
-    if (h264_ofile.is_open())
-        h264_ofile.write(reinterpret_cast<const char*>(data), count);
+    if (ofile && ofile->is_open())
+        ofile->write(reinterpret_cast<const char*>(data), count);
 
     decoder.feed(data, count);
 }
 
-static void mpeg2ts_parser_demux(ymn::mpeg2ts_parser& parser, const uint8_t *tspayload, std::size_t count, bool payload_unit_start_indicator)
-{
-    static enum {DMX_IDLE, DMX_HEADER, DMX_DATA} dmx_state = DMX_IDLE;
-    static std::size_t buffer_bytes = 0;
-    static uint8_t buffer[256];
-
-    mpeg2ts_parser_user_data* mpeg2ts_user_data =
-        static_cast<mpeg2ts_parser_user_data*>(parser.get_user_data());
-
-    const uint8_t* p;
-    std::size_t available;
-    std::size_t len;
-
-#define NEEDBYTES(x)                                                   \
-    do {                                                               \
-        int missing;                                                   \
-                                                                       \
-        missing = (x) - available;                                     \
-        if (missing > 0) {                                             \
-            if (0 == buffer_bytes) {                                   \
-                memcpy(buffer, p, available);                          \
-                buffer_bytes = available;                              \
-                return;                                                \
-            }                                                          \
-            else {                                                     \
-                if ((unsigned int)missing <= count) {                  \
-                    memcpy(buffer + buffer_bytes, tspayload, missing); \
-                    buffer_bytes += missing;                           \
-                    tspayload += missing;                              \
-                    count -= missing;                                  \
-                    available = (x);                                   \
-                }                                                      \
-                else {                                                 \
-                    memcpy(buffer + buffer_bytes, tspayload, count);   \
-                    buffer_bytes += count;                             \
-                    return;                                            \
-                }                                                      \
-            }                                                          \
-        }                                                              \
-    } while (0)
-
-    if (payload_unit_start_indicator) {
-        dmx_state = DMX_HEADER;
-        buffer_bytes = 0;
-    }
-
-    if (0 == buffer_bytes) {
-        p = tspayload;
-        available = count;
-    }
-    else {
-        p = buffer;
-        available = buffer_bytes;
-    }
-
-    switch (dmx_state) {
-        case DMX_IDLE:
-            return;
-
-        case DMX_HEADER:
-            NEEDBYTES(7);
-
-//fprintf(stdout, "0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n", p[0], p[1], p[2], p[3], p[4], p[5], p[6]);
-
-            /* 1110 xxxx - 13818-2 or 11172-2 video stream number xxxxx */
-            if ((p[0] != 0x00) || (p[1] != 0x00) || (p[2] != 0x01) ||
-                (p[3] <  0xe0) || (p[3] >  0xef) || ((p[6] & 0xc0) != 0x80 /* mpeg2 */)) {
-                dmx_state = DMX_IDLE;
-                return;
-            }
-
-            NEEDBYTES(9);
-            len = 9 + p[8];
-            NEEDBYTES(len);
-
-            if (0 == buffer_bytes) {
-                tspayload += len;
-                count -= len;
-            }
-
-            h264_decoder_feed(*mpeg2ts_user_data->h264_decoder, tspayload, count);
-            dmx_state = DMX_DATA;
-            return;
+static void h264_ofile_write_nal_unit(std::ofstream& ofile, const uint8_t* data, std::size_t count)
+{
+    static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
 
-        case DMX_DATA:
-            h264_decoder_feed(*mpeg2ts_user_data->h264_decoder, tspayload, count);
-            return;
+    /* bare NAL units are stored as annex b byte stream */
+    if (ofile.is_open()) {
+        ofile.write(reinterpret_cast<const char*>(start_code), sizeof(start_code));
+        ofile.write(reinterpret_cast<const char*>(data), count);
     }
-
-#undef NEEDBYTES
 }
 
-static void mpeg2ts_parser_handle_tspacket(ymn::mpeg2ts_parser& parser, const uint8_t *tspacket)
+static mpeg2ts_stream& mpeg2ts_parser_add_stream(mpeg2ts_parser_user_data& user_data, uint16_t pid, ymn::h264_decoder* decoder, std::ofstream* ofile)
 {
-    unsigned int adaptation_field_control;
-    unsigned int payload_offset; // offset to the first byte in the payload or 0 if payload is not present
-    unsigned int payload_unit_start_indicator;
-
-    adaptation_field_control = (tspacket[3] >> 4) & 0x03;
-
-    // 00 - reserved for future use by ISO/IEC
-    // ITU-T Rec. H.222.0 | ISO/IEC 13818-1 decoders shall discard Transport Stream packets
-    // with the adaptation_field_control field set to a value of '00'.
-    // 01 - no adaptation_field, payload only
-    // 10 - adaptation_field only, no payload
-    // 11 - adaptation_field followed by payload
-    switch (adaptation_field_control) {
-        case  0: payload_offset = 0; break;
-        case  1: payload_offset = 4; break;
-        case  2: payload_offset = 0; break;
-        case  3: payload_offset = 5 + tspacket[4]; break;
-        default: payload_offset = 0; break;
-    }
-
-    if (payload_offset) {
-        payload_unit_start_indicator = tspacket[1] & 0x40;
-        mpeg2ts_parser_demux(
-            parser,
-            tspacket + payload_offset,
-            MPEG2TS_PARSER_PACKET_SIZE - payload_offset,
-            payload_unit_start_indicator);
-    }
+    user_data.streams.emplace_back(pid, decoder,
+        [decoder, ofile](const uint8_t* data, std::size_t count) {
+            h264_decoder_feed(*decoder, ofile, data, count);
+        });
+
+    mpeg2ts_stream& stream = user_data.streams.back();
+    stream.demux.set_random_access_only(user_data.random_access_only);
+    decoder->set_intra_only(user_data.intra_only);
+    decoder->set_max_buffer_size(user_data.max_nal_size);
+    decoder->set_start_time(user_data.start_time);
+
+    return stream;
 }
 
 static void mpeg2ts_parser_parse(ymn::mpeg2ts_parser& parser)
 {
     ymn::mpeg2ts_parser_status_e status;
-    const uint8_t *tspacket;
+    const uint8_t *tspackets[TS_PARSER_BATCH_SIZE];
+    std::size_t count;
     mpeg2ts_parser_user_data* mpeg2ts_user_data;
     ymn::mpeg2ts_pid received_pid;
-    ymn::mpeg2ts_pid required_pid;
 
     mpeg2ts_user_data = static_cast<mpeg2ts_parser_user_data*>(parser.get_user_data());
-    required_pid = mpeg2ts_user_data->pid;
+    std::ostream& log = *mpeg2ts_user_data->log;
 
     do {
         status = parser.parse();
@@ -417,18 +874,27 @@ static void mpeg2ts_parser_parse(ymn::mpeg2ts_parser& parser)
 
         switch (status) {
             case ymn::mpeg2ts_parser_status_e::SYNC_GAINED:
-                std::cout << to_string(status) << std::endl;
+                log << to_string(status) << " (tspacket size: " << parser.get_tspacket_size() << ")" << std::endl;
                 break;
 
             case ymn::mpeg2ts_parser_status_e::SYNCHRONIZED:
-                tspacket = parser.get_tspacket();
-                received_pid = ymn::mpeg2ts_parser_get_pid(tspacket);
-                if (received_pid == required_pid)
-                    mpeg2ts_parser_handle_tspacket(parser, tspacket);
+                count = parser.get_tspackets(tspackets, TS_PARSER_BATCH_SIZE);
+                for (std::size_t n = 0; n < count; ++n) {
+                    received_pid = ymn::mpeg2ts_parser_get_pid(tspackets[n]);
+                    if (mpeg2ts_user_data->psi && mpeg2ts_user_data->psi->is_psi_pid(received_pid))
+                        mpeg2ts_user_data->psi->push(tspackets[n]);
+                    for (auto& stream : mpeg2ts_user_data->streams) {
+                        if (received_pid == stream.demux.get_pid()) {
+                            mpeg2ts_parser_select_stream(*mpeg2ts_user_data, stream);
+                            stream.demux.push(tspackets[n]);
+                            break;
+                        }
+                    }
+                }
                 break;
 
             case ymn::mpeg2ts_parser_status_e::SYNC_LOST:
-                std::cout << to_string(status) << std::endl;
+                log << to_string(status) << std::endl;
                 break;
 
             case ymn::mpeg2ts_parser_status_e::NOT_SYNCHRONIZED:
@@ -440,6 +906,58 @@ static void mpeg2ts_parser_parse(ymn::mpeg2ts_parser& parser)
     } while (status != ymn::mpeg2ts_parser_status_e::NEED_BYTES);
 }
 
+static void mpeg2ts_parser_select_stream(mpeg2ts_parser_user_data& user_data, const mpeg2ts_stream& stream)
+{
+    /* decoders log only while being fed, so it is enough
+       to mark where log of another stream begins */
+    if ((user_data.streams.size() > 1) && (user_data.logging_stream != &stream)) {
+        *user_data.log << std::endl << "pid: " << HEXDEC(stream.demux.get_pid()) << std::endl;
+        user_data.logging_stream = &stream;
+    }
+}
+
+static void mpeg2ts_parser_flush(mpeg2ts_parser_user_data& user_data)
+{
+    for (auto& stream : user_data.streams) {
+        mpeg2ts_parser_select_stream(user_data, stream);
+        stream.h264_decoder->flush();
+        *user_data.log << "continuity errors: " << stream.demux.get_cc_errors()
+            << " (lost ts packets: " << stream.demux.get_lost_tspackets()
+            << ", duplicate ts packets: " << stream.demux.get_duplicate_tspackets()
+            << ", damaged PES packets: " << stream.demux.get_damaged_pes_packets() << ")" << std::endl;
+    }
+}
+
+static void mpeg2ts_parser_psi_event(mpeg2ts_parser_user_data& user_data, ymn::mpeg2ts_psi_event_e event, uint16_t program_number, uint16_t pid)
+{
+    *user_data.log << std::endl << "program " << program_number << ": " << to_string(event) << " pid: " << HEXDEC(pid) << std::endl;
+
+    switch (event) {
+        case ymn::mpeg2ts_psi_event_e::STREAM_ADDED:
+        {
+            ymn::h264_decoder* decoder = new ymn::h264_decoder(ymn::h264_parser_container_e::ANNEX_B);
+            assert(decoder != nullptr);
+            decoder->set_ostream(*user_data.log);
+            mpeg2ts_parser_add_stream(user_data, pid, decoder, nullptr);
+            break;
+        }
+
+        case ymn::mpeg2ts_psi_event_e::STREAM_REMOVED:
+            for (auto it = user_data.streams.begin(); it != user_data.streams.end(); ++it) {
+                if (it->demux.get_pid() == pid) {
+                    mpeg2ts_parser_select_stream(user_data, *it);
+                    it->h264_decoder->flush();
+                    if (user_data.logging_stream == &*it)
+                        user_data.logging_stream = nullptr;
+                    delete it->h264_decoder;
+                    user_data.streams.erase(it);
+                    break;
+                }
+            }
+            break;
+    }
+}
+
 static void mpeg2ts_parser_feed(ymn::mpeg2ts_parser& parser, const uint8_t* data, std::size_t count)
 {
     std::size_t n_written;
@@ -463,3 +981,782 @@ static void mpeg2ts_parser_feed(ymn::mpeg2ts_parser& parser, const uint8_t* data
     } while (count > 0);
 }
 
+static void rtp_depacketizer_deliver(pipeline& pipeline, const encapsulation& encapsulation, const uint8_t* data, std::size_t count)
+{
+    if (encapsulation.ts) {
+        mpeg2ts_parser_feed(*pipeline.mpeg2ts_parser, data, count);
+    }
+    else {
+        h264_ofile_write_nal_unit(pipeline.h264_ofile, data, count);
+        pipeline.h264_decoder->feed_nal_unit(data, count);
+    }
+}
+
+static void rtp_parser_parse(ymn::rtp_parser& parser, ymn::rtp_depacketizer& depacketizer)
+{
+    ymn::rtp_parser_status_e status;
+
+    do {
+        status = parser.parse();
+
+        switch (status) {
+            case ymn::rtp_parser_status_e::PACKET_PARSED:
+                depacketizer.push(parser.get_header(), parser.get_payload(), parser.get_payload_size());
+                break;
+
+            case ymn::rtp_parser_status_e::PACKET_CORRUPTED:
+                std::cout << to_string(status) << std::endl;
+                break;
+
+            default:
+                break;
+        }
+    } while (status != ymn::rtp_parser_status_e::NEED_BYTES);
+}
+
+static void rtp_parser_feed(ymn::rtp_parser& parser, ymn::rtp_depacketizer& depacketizer, const uint8_t* data, std::size_t count)
+{
+    std::size_t n_written;
+
+    do {
+        n_written = parser.write(data, count);
+        if (0 == n_written) {
+            parser.reset();
+            continue;
+        }
+
+        rtp_parser_parse(parser, depacketizer);
+
+        data += n_written;
+        count -= n_written;
+    } while (count > 0);
+}
+
+static void feed(pipeline& pipeline, const uint8_t* data, std::size_t count, const encapsulation& encapsulation)
+{
+    if (encapsulation.rtp)
+        rtp_parser_feed(*pipeline.rtp_parser, *pipeline.rtp_depacketizer, data, count);
+    else
+    if (encapsulation.ts)
+        mpeg2ts_parser_feed(*pipeline.mpeg2ts_parser, data, count);
+    else
+        h264_decoder_feed(*pipeline.h264_decoder, &pipeline.h264_ofile, data, count);
+}
+
+static std::size_t ifstream_feed(pipeline& pipeline, std::ifstream& file, const encapsulation& encapsulation)
+{
+    std::size_t read_bytes = 0;
+    std::streamsize count;
+    char* memblock;
+
+    memblock = new char[READ_BUFFER_SIZE];
+
+    do {
+        count = file.readsome(memblock, READ_BUFFER_SIZE);
+        read_bytes += count;
+        if (count > 0)
+            feed(pipeline, reinterpret_cast<uint8_t*>(memblock), count, encapsulation);
+    } while (count > 0);
+
+    delete [] memblock;
+
+    return read_bytes;
+}
+
+static void mapped_file_feed(pipeline& pipeline, const ymn::mapped_file& file, const encapsulation& encapsulation)
+{
+    const uint8_t* data = file.data();
+    std::size_t size = file.size();
+    std::size_t offset = 0;
+
+    file.advise_sequential();
+
+    /* Parsers work directly on the mapping. It is exposed to them window by window,
+       so that the kernel can be asked to read ahead next window in the meantime. */
+    while (offset < size) {
+        std::size_t count = std::min(size - offset, static_cast<std::size_t>(MMAP_WINDOW_SIZE));
+
+        file.willneed(offset + count, MMAP_WINDOW_SIZE);
+
+        if (encapsulation.rtp)
+            /* rtp packets are reassembled, so they are copied anyway */
+            rtp_parser_feed(*pipeline.rtp_parser, *pipeline.rtp_depacketizer, data + offset, count);
+        else
+        if (encapsulation.ts) {
+            if (0 == offset)
+                pipeline.mpeg2ts_parser->attach(data, count);
+            else
+                pipeline.mpeg2ts_parser->extend(count);
+            mpeg2ts_parser_parse(*pipeline.mpeg2ts_parser);
+        }
+        else {
+            if (pipeline.h264_ofile.is_open())
+                pipeline.h264_ofile.write(reinterpret_cast<const char*>(data + offset), count);
+            if (0 == offset)
+                pipeline.h264_decoder->attach(data, count);
+            else
+                pipeline.h264_decoder->extend(count);
+        }
+
+        offset += count;
+    }
+
+    /* last NAL unit still points into the mapping, so it cannot wait till the end of main() */
+    pipeline.h264_decoder->flush();
+}
+
+static std::size_t file_reader_feed(pipeline& pipeline, ymn::file_reader& reader, const encapsulation& encapsulation)
+{
+    std::size_t read_bytes = 0;
+    const ymn::file_reader::block* b;
+
+    while ((b = reader.acquire()) != nullptr) {
+        read_bytes += b->size;
+
+        feed(pipeline, b->data, b->size, encapsulation);
+
+        reader.release(b);
+    }
+
+    return read_bytes;
+}
+
+static std::size_t mp4_feed(pipeline& pipeline, const ymn::mapped_file& file)
+{
+    ymn::mp4_demuxer demuxer;
+    ymn::h264::avcc avcc;
+    std::vector<ymn::mp4_demuxer::sample> samples;
+    std::size_t read_bytes = 0;
+
+    /* only box headers, moov box and sync samples are going to be touched */
+    file.advise_random();
+
+    if (!demuxer.open(file.data(), file.size())) {
+        std::cerr << "error: no avc video track found" << std::endl;
+        return 0;
+    }
+
+    std::cout << demuxer.to_string() << std::endl;
+
+    if (!pipeline.h264_decoder->configure(demuxer.get_avcc(), demuxer.get_avcc_size()))
+        return 0;
+
+    if (pipeline.h264_ofile.is_open() &&
+        ymn::h264_parse_avc_decoder_configuration_record(demuxer.get_avcc(), demuxer.get_avcc_size(), avcc)) {
+        for (const auto& nal_unit : avcc.sequence_parameter_sets)
+            h264_ofile_write_nal_unit(pipeline.h264_ofile, nal_unit.data, nal_unit.size);
+        for (const auto& nal_unit : avcc.picture_parameter_sets)
+            h264_ofile_write_nal_unit(pipeline.h264_ofile, nal_unit.data, nal_unit.size);
+    }
+
+    samples = demuxer.get_sync_samples();
+
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        const uint8_t* data = file.data() + samples[i].offset;
+        const std::size_t size = samples[i].size;
+
+        if (i + 1 < samples.size())
+            file.willneed(samples[i + 1].offset, samples[i + 1].size);
+
+        if (pipeline.h264_ofile.is_open()) {
+            const std::size_t nal_length_size = avcc.length_size_minus_one + 1;
+            std::size_t n = 0;
+
+            while (n + nal_length_size <= size) {
+                std::size_t nal_unit_size = 0;
+                for (std::size_t k = 0; k < nal_length_size; ++k)
+                    nal_unit_size = (nal_unit_size << 8) | data[n + k];
+                n += nal_length_size;
+                if (nal_unit_size > size - n)
+                    break;
+                h264_ofile_write_nal_unit(pipeline.h264_ofile, data + n, nal_unit_size);
+                n += nal_unit_size;
+            }
+        }
+
+        /* every sample consists of complete NAL units, so it can be parsed in place */
+        pipeline.h264_decoder->attach(data, size);
+
+        read_bytes += size;
+    }
+
+    /* parser must not be left attached to the mapping */
+    pipeline.h264_decoder->flush();
+
+    return read_bytes;
+}
+
+static bool keyframes_parse(const char* list, std::size_t number_of_keyframes, std::vector<std::size_t>& keyframes)
+{
+    keyframes.clear();
+
+    if (nullptr == list) {
+        for (std::size_t i = 0; i < number_of_keyframes; ++i)
+            keyframes.push_back(i);
+        return true;
+    }
+
+    std::istringstream stream(list);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        const std::size_t dash = item.find('-');
+        const std::string first_str = item.substr(0, dash);
+        const std::string last_str = (dash == std::string::npos) ? first_str : item.substr(dash + 1);
+        uint32_t first, last;
+
+        if ((ymn::strtointeger_conversion_status_e::success != ymn::strtointeger(first_str.c_str(), first)) ||
+            (ymn::strtointeger_conversion_status_e::success != ymn::strtointeger(last_str.c_str(), last)) ||
+            (first > last))
+            return false;
+
+        for (std::size_t i = first; (i <= last) && (i < number_of_keyframes); ++i)
+            keyframes.push_back(i);
+    }
+
+    return true;
+}
+
+static void keyframe_index_build(const ymn::mapped_file& file, const encapsulation& encapsulation, uint16_t pid, ymn::keyframe_index& index)
+{
+    ymn::keyframe_indexer indexer(index);
+
+    file.advise_sequential();
+
+    if (encapsulation.ts) {
+        ymn::mpeg2ts_parser mpeg2ts_parser(TS_PARSER_BUFFER_SIZE);
+        ymn::mpeg2ts_parser_status_e status;
+        bool pes_packet = false;
+
+        mpeg2ts_parser.attach(file.data(), file.size());
+
+        do {
+            status = mpeg2ts_parser.parse();
+            if ((status == ymn::mpeg2ts_parser_status_e::SYNC_GAINED) && (0 == index.tspacket_size))
+                index.tspacket_size = mpeg2ts_parser.get_tspacket_size();
+            if (status != ymn::mpeg2ts_parser_status_e::SYNCHRONIZED)
+                continue;
+
+            const uint8_t* tspacket = mpeg2ts_parser.get_tspacket();
+            if (ymn::mpeg2ts_parser_get_pid(tspacket) != pid)
+                continue;
+
+            const unsigned int payload_offset = ymn::mpeg2ts_parser_get_payload_offset(tspacket);
+            if (0 == payload_offset)
+                continue;
+
+            const uint8_t* payload = tspacket + payload_offset;
+            std::size_t count = MPEG2TS_PARSER_PACKET_SIZE - payload_offset;
+
+            if (ymn::mpeg2ts_parser_get_payload_unit_start_indicator(tspacket)) {
+                const std::size_t header_size = ymn::mpeg2ts_parser_get_pes_header_size(payload, count);
+                uint64_t pts = KEYFRAME_INDEX_NO_PTS;
+
+                /* decoding of a key frame starts from the ts packet carrying beginning of its PES packet */
+                pes_packet = (header_size > 0);
+                if (pes_packet) {
+                    ymn::mpeg2ts_parser_get_pes_pts(payload, pts);
+                    indexer.unit_start(tspacket - file.data(), pts);
+                    payload += header_size;
+                    count -= header_size;
+                }
+            }
+
+            if (pes_packet)
+                indexer.feed(payload, count, 0);
+        } while (status != ymn::mpeg2ts_parser_status_e::NEED_BYTES);
+    }
+    else {
+        indexer.feed(file.data(), file.size(), 0);
+    }
+
+    indexer.finish(file.size());
+
+    index.ts = encapsulation.ts;
+    index.pid = encapsulation.ts ? pid : 0;
+    if (encapsulation.ts && (0 == index.tspacket_size))
+        index.tspacket_size = MPEG2TS_PARSER_PACKET_SIZE;
+    index.file_size = file.size();
+}
+
+static std::size_t keyframe_index_feed(pipeline& pipeline, const ymn::mapped_file& file, const ymn::keyframe_index& index, const std::vector<std::size_t>& keyframes)
+{
+    uint32_t sps = KEYFRAME_INDEX_NO_PARAMETER_SET;
+    uint32_t pps = KEYFRAME_INDEX_NO_PARAMETER_SET;
+    std::size_t read_bytes = 0;
+
+    /* only indexed key frames are going to be touched */
+    file.advise_random();
+
+    for (std::size_t i = 0; i < keyframes.size(); ++i) {
+        const ymn::keyframe_index::keyframe& kf = index.keyframes[keyframes[i]];
+
+        if ((kf.offset > file.size()) || (kf.size > file.size() - kf.offset)) {
+            std::cerr << "error: key frame #" << keyframes[i] << " lies outside of the file" << std::endl;
+            break;
+        }
+
+        if (i + 1 < keyframes.size()) {
+            const ymn::keyframe_index::keyframe& next = index.keyframes[keyframes[i + 1]];
+            file.willneed(next.offset, next.size);
+        }
+
+        std::cout << "keyframe #" << keyframes[i] << " offset: " << kf.offset << " size: " << kf.size;
+        if (kf.pts != KEYFRAME_INDEX_NO_PTS)
+            std::cout << " pts: " << kf.pts;
+        std::cout << std::endl;
+
+        /* parameter sets might have been sent long before the key frame */
+        if ((kf.sps != KEYFRAME_INDEX_NO_PARAMETER_SET) && (kf.sps != sps)) {
+            const std::vector<uint8_t>& nal_unit = index.parameter_sets[kf.sps].nal_unit;
+            h264_ofile_write_nal_unit(pipeline.h264_ofile, nal_unit.data(), nal_unit.size());
+            pipeline.h264_decoder->feed_nal_unit(nal_unit.data(), nal_unit.size());
+            sps = kf.sps;
+        }
+
+        if ((kf.pps != KEYFRAME_INDEX_NO_PARAMETER_SET) && (kf.pps != pps)) {
+            const std::vector<uint8_t>& nal_unit = index.parameter_sets[kf.pps].nal_unit;
+            h264_ofile_write_nal_unit(pipeline.h264_ofile, nal_unit.data(), nal_unit.size());
+            pipeline.h264_decoder->feed_nal_unit(nal_unit.data(), nal_unit.size());
+            pps = kf.pps;
+        }
+
+        if (index.ts) {
+            ymn::mpeg2ts_demux& demux = pipeline.mpeg2ts_user_data.streams.front().demux;
+            demux.discontinuity();
+            demux.push(file.data() + kf.offset, kf.size, index.tspacket_size);
+        }
+        else {
+            if (pipeline.h264_ofile.is_open())
+                pipeline.h264_ofile.write(reinterpret_cast<const char*>(file.data() + kf.offset), kf.size);
+            pipeline.h264_decoder->attach(file.data() + kf.offset, kf.size);
+        }
+
+        /* access unit ends where the next one begins */
+        pipeline.h264_decoder->flush();
+
+        read_bytes += kf.size;
+    }
+
+    return read_bytes;
+}
+
+static std::size_t parallel_feed(const ymn::mapped_file& file, const encapsulation& encapsulation, uint16_t pid, bool intra_only, std::size_t max_nal_size, unsigned int threads)
+{
+    ymn::keyframe_index index;
+    std::vector<decoding_range> ranges;
+    std::vector<std::string> logs;
+    std::vector<bool> decoded;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> next_range{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint64_t offset = 0;
+    uint32_t sps[H264_PARSER_MAX_NUMBER_OF_SPS];
+    uint32_t pps[H264_PARSER_MAX_NUMBER_OF_PPS];
+    std::size_t next_parameter_set = 0;
+    std::vector<uint32_t> parameter_sets;
+
+    std::fill(std::begin(sps), std::end(sps), KEYFRAME_INDEX_NO_PARAMETER_SET);
+    std::fill(std::begin(pps), std::end(pps), KEYFRAME_INDEX_NO_PARAMETER_SET);
+
+    /* scanning is much cheaper than decoding, so it is done up front by this thread */
+    keyframe_index_build(file, encapsulation, pid, index);
+
+    /* every IDR picture starts a range which can be decoded independently of the others */
+    for (const auto& kf : index.keyframes) {
+        if (static_cast<ymn::nal_unit_type_e>(kf.nal_unit_type) != ymn::nal_unit_type_e::CODED_SLICE_IDR_PICTURE)
+            continue;
+        if (kf.offset > offset)
+            ranges.push_back({offset, kf.offset - offset, parameter_sets});
+        offset = kf.offset;
+
+        /* later I slices of the range may refer to any parameter set received so far,
+           so the range gets all of them (as the indexer knew them at its beginning) */
+        for (; next_parameter_set < index.parameter_sets.size(); ++next_parameter_set) {
+            const ymn::keyframe_index::parameter_set& ps = index.parameter_sets[next_parameter_set];
+            if (ps.offset >= kf.offset)
+                break;
+            if (static_cast<ymn::nal_unit_type_e>(ps.nal_unit_type) == ymn::nal_unit_type_e::SPS)
+                sps[ps.id] = next_parameter_set;
+            else
+                pps[ps.id] = next_parameter_set;
+        }
+
+        parameter_sets.clear();
+        for (uint32_t i : sps)
+            if (i != KEYFRAME_INDEX_NO_PARAMETER_SET)
+                parameter_sets.push_back(i);
+        for (uint32_t i : pps)
+            if (i != KEYFRAME_INDEX_NO_PARAMETER_SET)
+                parameter_sets.push_back(i);
+    }
+    if (file.size() > offset)
+        ranges.push_back({offset, file.size() - offset, parameter_sets});
+
+    std::cout << "decoding " << ranges.size() << " ranges using " << threads << " threads" << std::endl;
+
+    logs.resize(ranges.size());
+    decoded.resize(ranges.size(), false);
+
+    auto worker = [&]() {
+        ymn::h264_decoder* decoder = new ymn::h264_decoder(ymn::h264_parser_container_e::ANNEX_B);
+        decoder->set_intra_only(intra_only);
+        decoder->set_max_buffer_size(max_nal_size);
+        mpeg2ts_stream stream(pid, decoder,
+            [decoder](const uint8_t* data, std::size_t count) {
+                decoder->feed(data, count);
+            });
+        std::ostringstream log;
+        std::ostream discard(nullptr);
+
+        /* time of pictures is counted from the beginning of the file, not of the range */
+        if (!index.keyframes.empty() && (index.keyframes.front().pts != KEYFRAME_INDEX_NO_PTS))
+            decoder->set_time_origin(index.keyframes.front().pts);
+
+        for (;;) {
+            const std::size_t i = next_range++;
+            if (i >= ranges.size())
+                break;
+
+            const decoding_range& range = ranges[i];
+
+            log.str("");
+
+            /* parameter sets carried over from preceding ranges are not logged again */
+            decoder->set_ostream(discard);
+
+            for (uint32_t parameter_set : range.parameter_sets) {
+                const std::vector<uint8_t>& nal_unit = index.parameter_sets[parameter_set].nal_unit;
+                decoder->feed_nal_unit(nal_unit.data(), nal_unit.size());
+            }
+
+            decoder->set_ostream(log);
+
+            if (encapsulation.ts) {
+                stream.demux.reset();
+                stream.demux.push(file.data() + range.offset, range.size, index.tspacket_size);
+            }
+            else {
+                decoder->attach(file.data() + range.offset, range.size);
+            }
+
+            decoder->flush();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                logs[i] = log.str();
+                decoded[i] = true;
+            }
+            condition.notify_all();
+        }
+
+        delete decoder;
+    };
+
+    for (unsigned int t = 0; t < threads; ++t)
+        workers.emplace_back(worker);
+
+    /* logs are printed in file order, as soon as all preceding ranges are decoded */
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+        std::string log;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() { return decoded[i]; });
+            log.swap(logs[i]);
+        }
+        std::cout << log;
+    }
+
+    for (auto& w : workers)
+        w.join();
+
+    return file.size();
+}
+
+static std::size_t seek_feed(pipeline& pipeline, const ymn::mapped_file& file, uint16_t pid, const std::vector<uint64_t>& times, uint64_t step)
+{
+    ymn::mpeg2ts_seeker seeker(file.data(), file.size(), pid);
+    ymn::keyframe_index index;
+    std::vector<uint64_t> targets(times);
+    std::vector<std::size_t> keyframes;
+
+    /* only small parts of the file are going to be touched */
+    file.advise_random();
+
+    if (!seeker.open()) {
+        std::cerr << "error: no PCR or PTS of pid " << HEXDEC(pid) << " found at the beginning of the file" << std::endl;
+        return 0;
+    }
+
+    std::cout << seeker.to_string() << std::endl;
+
+    if (step > 0)
+        for (uint64_t t = 0; t <= seeker.get_duration(); t += step)
+            targets.push_back(t);
+
+    /* key frames are decoded in file order and each one once */
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    seeker.prepare_index(index);
+
+    for (const auto t : targets) {
+        const std::size_t n = index.keyframes.size();
+
+        if (!seeker.seek(t, index)) {
+            std::cout << "seek " << ymn::h264_decoder_time_to_string(t) << ": no key frame found" << std::endl;
+            continue;
+        }
+
+        std::cout << "seek " << ymn::h264_decoder_time_to_string(t) << ": key frame at offset " << index.keyframes[n].offset
+            << " (probes: " << seeker.get_probes() << ")" << std::endl;
+
+        /* for times closer than the distance of key frames the same one is found again
+           (targets are sorted, so it can only be the previous one) */
+        if ((n > 0) && (index.keyframes[n].offset == index.keyframes[n - 1].offset))
+            index.keyframes.pop_back();
+        else
+            keyframes.push_back(n);
+    }
+
+    std::cout << "scanned " << seeker.get_scanned_bytes() << " bytes to locate " << keyframes.size() << " key frames" << std::endl;
+
+    /* times are counted from the first picture of the stream */
+    pipeline.h264_decoder->set_time_origin(seeker.get_first_pts());
+
+    return keyframe_index_feed(pipeline, file, index, keyframes);
+}
+
+static bool batch_add_input(const std::string& name, std::vector<std::string>& filenames)
+{
+    struct stat st;
+
+    if ("-" == name) {
+        std::string line;
+        while (std::getline(std::cin, line))
+            if (!line.empty())
+                filenames.push_back(line);
+        return true;
+    }
+
+    if (0 != stat(name.c_str(), &st))
+        return false;
+
+    if (!S_ISDIR(st.st_mode)) {
+        filenames.push_back(name);
+        return true;
+    }
+
+    DIR* dir = opendir(name.c_str());
+    if (nullptr == dir)
+        return false;
+
+    std::vector<std::string> entries;
+    struct dirent* entry;
+
+    while ((entry = readdir(dir)) != nullptr) {
+        const std::string path = name + "/" + entry->d_name;
+        if ((0 == stat(path.c_str(), &st)) && S_ISREG(st.st_mode))
+            entries.push_back(path);
+    }
+
+    closedir(dir);
+
+    /* readdir() gives no particular order */
+    std::sort(entries.begin(), entries.end());
+    filenames.insert(filenames.end(), entries.begin(), entries.end());
+
+    return true;
+}
+
+static std::size_t batch_feed(const std::vector<std::string>& filenames, const encapsulation& encapsulation, uint16_t pid, bool random_access_only, bool intra_only, std::size_t max_nal_size, unsigned int jobs)
+{
+    std::vector<std::string> logs(filenames.size());
+    std::vector<bool> decoded(filenames.size(), false);
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> next_file{0};
+    std::atomic<std::size_t> read_bytes{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    std::cout << "decoding " << filenames.size() << " files using " << jobs << " workers" << std::endl;
+
+    auto worker = [&]() {
+        /* decoder and ts parser live as long as the worker, not just for one file */
+        ymn::h264_decoder* decoder = new ymn::h264_decoder(ymn::h264_parser_container_e::ANNEX_B);
+        ymn::mpeg2ts_parser* parser = nullptr;
+        mpeg2ts_parser_user_data user_data;
+        std::ostringstream log;
+
+        decoder->set_ostream(log);
+
+        user_data.logging_stream = nullptr;
+        user_data.log = &log;
+        user_data.psi = nullptr;
+        user_data.random_access_only = random_access_only;
+        user_data.intra_only = intra_only;
+        user_data.max_nal_size = max_nal_size;
+        user_data.start_time = 0;
+        mpeg2ts_parser_add_stream(user_data, pid, decoder, nullptr);
+
+        if (encapsulation.ts) {
+            parser = new ymn::mpeg2ts_parser(TS_PARSER_BUFFER_SIZE);
+            parser->set_pid_filter(false);
+            parser->set_pid_filter(pid, true);
+        }
+
+        for (;;) {
+            const std::size_t i = next_file++;
+            if (i >= filenames.size())
+                break;
+
+            ymn::mapped_file file;
+
+            log.str("");
+            log << "file: '" << filenames[i] << "'" << std::endl;
+
+            if (file.open(filenames[i].c_str())) {
+                file.advise_sequential();
+
+                decoder->reset();
+
+                if (parser) {
+                    user_data.streams.front().demux.reset();
+                    parser->reset();
+                    parser->set_user_data(&user_data);
+                    parser->attach(file.data(), file.size());
+                    mpeg2ts_parser_parse(*parser);
+                    mpeg2ts_parser_flush(user_data);
+                }
+                else {
+                    decoder->attach(file.data(), file.size());
+                    decoder->flush();
+                }
+
+                log << "mapped " << file.size() << " bytes from '" << filenames[i] << "'" << std::endl;
+                read_bytes += file.size();
+
+                file.close();
+            }
+            else {
+                log << "error: could not map '" << filenames[i] << "'" << std::endl;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                logs[i] = log.str();
+                decoded[i] = true;
+            }
+            condition.notify_all();
+        }
+
+        if (parser)
+            delete parser;
+
+        delete decoder;
+    };
+
+    for (unsigned int t = 0; t < jobs; ++t)
+        workers.emplace_back(worker);
+
+    /* logs are printed in the order of files, as soon as all preceding files are decoded */
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        std::string log;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() { return decoded[i]; });
+            log.swap(logs[i]);
+        }
+        std::cout << log;
+    }
+
+    for (auto& w : workers)
+        w.join();
+
+    return read_bytes;
+}
+
+static bool pids_parse(const char* list, std::vector<uint16_t>& pids)
+{
+    std::istringstream stream(list);
+    std::string item;
+    uint16_t pid;
+
+    pids.clear();
+
+    while (std::getline(stream, item, ',')) {
+        if ((ymn::strtointeger_conversion_status_e::success != ymn::strtointeger(item.c_str(), pid)) ||
+            (pid > MPEG2TS_PID_MAX))
+            return false;
+        if (std::find(pids.begin(), pids.end(), pid) == pids.end())
+            pids.push_back(pid);
+    }
+
+    return !pids.empty();
+}
+
+/* comma separated list of times or '/step' */
+static bool seek_times_parse(const char* list, std::vector<uint64_t>& times, uint64_t& step)
+{
+    std::istringstream stream(list);
+    std::string item;
+    uint64_t time;
+
+    times.clear();
+    step = 0;
+
+    if ('/' == list[0])
+        return time_parse(list + 1, step) && (step > 0);
+
+    while (std::getline(stream, item, ',')) {
+        if (!time_parse(item.c_str(), time))
+            return false;
+        times.push_back(time);
+    }
+
+    return !times.empty();
+}
+
+/* [[hh:]mm:]ss[.fff] converted to 90 kHz units */
+static bool time_parse(const char* str, uint64_t& time)
+{
+    std::istringstream stream(str);
+    std::string item;
+    std::vector<std::string> fields;
+    uint64_t seconds = 0;
+    uint64_t milliseconds = 0;
+
+    auto is_number = [](const std::string& s) {
+        return !s.empty() && (s.size() <= 9) &&
+            std::all_of(s.begin(), s.end(), [](char c) { return (c >= '0') && (c <= '9'); });
+    };
+
+    while (std::getline(stream, item, ':'))
+        fields.push_back(item);
+
+    if (fields.empty() || (fields.size() > 3))
+        return false;
+
+    std::string& last = fields.back();
+    const std::size_t dot = last.find('.');
+    if (dot != std::string::npos) {
+        const std::string fraction = last.substr(dot + 1);
+        if (!is_number(fraction) || (fraction.size() > 3))
+            return false;
+        milliseconds = std::strtoull(fraction.c_str(), nullptr, 10);
+        for (std::size_t i = fraction.size(); i < 3; ++i)
+            milliseconds *= 10;
+        last.erase(dot);
+    }
+
+    for (const auto& field : fields) {
+        if (!is_number(field))
+            return false;
+        seconds = seconds * 60 + std::strtoull(field.c_str(), nullptr, 10);
+    }
+
+    time = seconds * H264_DECODER_TIMESTAMP_CLOCK + milliseconds * (H264_DECODER_TIMESTAMP_CLOCK / 1000);
+
+    return true;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file mapped_file.hpp
+ *
+ * Definition of read-only memory mapped file.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+
+#include <cstdint>
+
+extern "C" {
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+}
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+class mapped_file
+{
+public:
+    explicit mapped_file() :
+        m_fd(-1),
+        m_data(nullptr),
+        m_size(0)
+    {
+    }
+
+    ~mapped_file()
+    {
+        close();
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file(mapped_file&&) = delete;
+    mapped_file& operator = (const mapped_file&) = delete;
+    mapped_file& operator = (mapped_file&&) = delete;
+
+    /**
+     * Maps whole content of the file (read-only) into process address space.
+     *
+     * @param[in] filename Name of the file to be mapped.
+     *
+     * @return true on success, false otherwise.
+     *
+     * @note Empty file is considered as successfully mapped (with size 0).
+     */
+    bool open(const char* filename)
+    {
+        struct stat st;
+
+        close();
+
+        m_fd = ::open(filename, O_RDONLY);
+        if (m_fd < 0)
+            return false;
+
+        if ((fstat(m_fd, &st) < 0) || !S_ISREG(st.st_mode)) {
+            close();
+            return false;
+        }
+
+        m_size = st.st_size;
+        if (m_size > 0) {
+            void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+            if (MAP_FAILED == p) {
+                close();
+                return false;
+            }
+            m_data = static_cast<const uint8_t*>(p);
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data)
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+
+        if (m_fd >= 0)
+            ::close(m_fd);
+
+        m_fd = -1;
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool is_open() const
+    {
+        return m_fd >= 0;
+    }
+
+    const uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * Tells the kernel that the mapping will be accessed sequentially,
+     * so it can read ahead aggressively and drop pages behind.
+     */
+    void advise_sequential() const
+    {
+        advise(0, m_size, MADV_SEQUENTIAL);
+    }
+
+    /**
+     * Tells the kernel that the mapping will be accessed in random order,
+     * so it shall not read ahead more than requested.
+     */
+    void advise_random() const
+    {
+        advise(0, m_size, MADV_RANDOM);
+    }
+
+    /**
+     * Asks the kernel to start reading given range of the file in advance.
+     *
+     * @param[in] offset Offset (in bytes) of the range.
+     * @param[in] count  Length (in bytes) of the range.
+     */
+    void willneed(std::size_t offset, std::size_t count) const
+    {
+        advise(offset, count, MADV_WILLNEED);
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "mapped_file@";
+        stream << std::hex << this;
+        stream << " [fd: ";
+        stream << std::dec << m_fd;
+        stream << ", size: ";
+        stream << std::dec << m_size;
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    void advise(std::size_t offset, std::size_t count, int advice) const
+    {
+        /* madvise() requires page aligned address */
+        const std::size_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+        std::size_t aligned_offset;
+
+        if ((nullptr == m_data) || (offset >= m_size))
+            return;
+
+        if (count > m_size - offset)
+            count = m_size - offset;
+
+        aligned_offset = offset & ~page_mask;
+        count += offset - aligned_offset;
+
+        madvise(const_cast<uint8_t*>(m_data) + aligned_offset, count, advice);
+    }
+
+    int m_fd;
+    const uint8_t* m_data;
+    std::size_t m_size;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _MAPPED_FILE_HPP_ */
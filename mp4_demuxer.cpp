@@ -0,0 +1,423 @@
+/**
+ * @file mp4_demuxer.cpp
+ *
+ * ISO/IEC 14496-12 (ISO base media file format, MP4) demuxer.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "mp4_demuxer.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define MP4_BOX_HEADER_SIZE                  8
+#define MP4_FULL_BOX_HEADER_SIZE             4 /* version and flags */
+
+/* 12.1.3 VisualSampleEntry fields (including SampleEntry ones) preceding child boxes */
+#define MP4_VISUAL_SAMPLE_ENTRY_SIZE        78
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+static bool mp4_read_box_header(const uint8_t* p, std::size_t available,
+    uint32_t& type, std::size_t& header_size, std::size_t& box_size);
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+static inline uint32_t mp4_be16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t mp4_be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64_t mp4_be64(const uint8_t* p)
+{
+    return (static_cast<uint64_t>(mp4_be32(p)) << 32) | mp4_be32(p + 4);
+}
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+mp4_demuxer::mp4_demuxer() :
+    m_track_id(0),
+    m_avcc(nullptr),
+    m_avcc_size(0),
+    m_samples(),
+    m_number_of_sync_samples(0),
+    m_file_size(0)
+{
+}
+
+mp4_demuxer::~mp4_demuxer()
+{
+}
+
+bool mp4_demuxer::open(const uint8_t* data, std::size_t size)
+{
+    sample_table table = {};
+
+    reset();
+
+    m_file_size = size;
+
+    /* top level boxes - only 'moov' is looked into */
+    parse_boxes(data, size, table);
+
+    return m_avcc != nullptr;
+}
+
+void mp4_demuxer::reset()
+{
+    m_track_id = 0;
+    m_avcc = nullptr;
+    m_avcc_size = 0;
+    m_samples.clear();
+    m_number_of_sync_samples = 0;
+    m_file_size = 0;
+}
+
+std::vector<mp4_demuxer::sample> mp4_demuxer::get_sync_samples() const
+{
+    std::vector<sample> sync_samples;
+
+    sync_samples.reserve(m_number_of_sync_samples);
+    for (const auto& s : m_samples)
+        if (s.sync)
+            sync_samples.push_back(s);
+
+    return sync_samples;
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+bool mp4_demuxer::parse_boxes(const uint8_t* p, std::size_t size, sample_table& table)
+{
+    while (size >= MP4_BOX_HEADER_SIZE) {
+        uint32_t type;
+        std::size_t header_size;
+        std::size_t box_size;
+
+        if (!mp4_read_box_header(p, size, type, header_size, box_size))
+            return false;
+
+        if (!parse_box(type, p + header_size, box_size - header_size, table))
+            return false;
+
+        p += box_size;
+        size -= box_size;
+    }
+
+    return true;
+}
+
+bool mp4_demuxer::parse_box(uint32_t type, const uint8_t* p, std::size_t size, sample_table& table)
+{
+    switch (type) {
+        case MP4_FOURCC('m', 'o', 'o', 'v'):
+        case MP4_FOURCC('m', 'd', 'i', 'a'):
+        case MP4_FOURCC('m', 'i', 'n', 'f'):
+        case MP4_FOURCC('s', 't', 'b', 'l'):
+            return parse_boxes(p, size, table);
+
+        case MP4_FOURCC('t', 'r', 'a', 'k'):
+        {
+            sample_table track = {};
+
+            /* a broken track shall not prevent finding a good one */
+            if (parse_boxes(p, size, track) &&
+                (nullptr == m_avcc) &&
+                (MP4_FOURCC('v', 'i', 'd', 'e') == track.handler_type) &&
+                (nullptr != track.avcc))
+                build_samples(track);
+            return true;
+        }
+
+        case MP4_FOURCC('t', 'k', 'h', 'd'):
+            if (size < MP4_FULL_BOX_HEADER_SIZE + 20)
+                return false;
+            /* creation_time and modification_time are 32 or 64 bit wide */
+            table.track_id = mp4_be32(p + MP4_FULL_BOX_HEADER_SIZE + (p[0] == 1 ? 16 : 8));
+            return true;
+
+        case MP4_FOURCC('h', 'd', 'l', 'r'):
+            if (size < MP4_FULL_BOX_HEADER_SIZE + 8)
+                return false;
+            table.handler_type = mp4_be32(p + MP4_FULL_BOX_HEADER_SIZE + 4);
+            return true;
+
+        case MP4_FOURCC('s', 't', 's', 'd'):
+            return parse_stsd(p, size, table);
+
+        case MP4_FOURCC('s', 't', 's', 's'):
+        {
+            uint32_t entry_count;
+
+            if (size < MP4_FULL_BOX_HEADER_SIZE + 4)
+                return false;
+            p += MP4_FULL_BOX_HEADER_SIZE;
+            entry_count = mp4_be32(p);
+            p += 4;
+            if ((size - MP4_FULL_BOX_HEADER_SIZE - 4) / 4 < entry_count)
+                return false;
+
+            table.has_stss = true;
+            table.stss.resize(entry_count);
+            for (uint32_t i = 0; i < entry_count; ++i, p += 4)
+                table.stss[i] = mp4_be32(p);
+            return true;
+        }
+
+        case MP4_FOURCC('s', 't', 's', 'z'):
+        {
+            if (size < MP4_FULL_BOX_HEADER_SIZE + 8)
+                return false;
+            p += MP4_FULL_BOX_HEADER_SIZE;
+            table.stsz_sample_size = mp4_be32(p);
+            table.stsz_sample_count = mp4_be32(p + 4);
+            p += 8;
+
+            if (0 == table.stsz_sample_size) {
+                if ((size - MP4_FULL_BOX_HEADER_SIZE - 8) / 4 < table.stsz_sample_count)
+                    return false;
+                table.stsz.resize(table.stsz_sample_count);
+                for (uint32_t i = 0; i < table.stsz_sample_count; ++i, p += 4)
+                    table.stsz[i] = mp4_be32(p);
+            }
+            return true;
+        }
+
+        case MP4_FOURCC('s', 't', 'c', 'o'):
+        case MP4_FOURCC('c', 'o', '6', '4'):
+        {
+            const std::size_t entry_size = (MP4_FOURCC('c', 'o', '6', '4') == type) ? 8 : 4;
+            uint32_t entry_count;
+
+            if (size < MP4_FULL_BOX_HEADER_SIZE + 4)
+                return false;
+            p += MP4_FULL_BOX_HEADER_SIZE;
+            entry_count = mp4_be32(p);
+            p += 4;
+            if ((size - MP4_FULL_BOX_HEADER_SIZE - 4) / entry_size < entry_count)
+                return false;
+
+            table.stco.resize(entry_count);
+            for (uint32_t i = 0; i < entry_count; ++i, p += entry_size)
+                table.stco[i] = (8 == entry_size) ? mp4_be64(p) : mp4_be32(p);
+            return true;
+        }
+
+        case MP4_FOURCC('s', 't', 's', 'c'):
+        {
+            uint32_t entry_count;
+
+            if (size < MP4_FULL_BOX_HEADER_SIZE + 4)
+                return false;
+            p += MP4_FULL_BOX_HEADER_SIZE;
+            entry_count = mp4_be32(p);
+            p += 4;
+            if ((size - MP4_FULL_BOX_HEADER_SIZE - 4) / 12 < entry_count)
+                return false;
+
+            table.stsc.resize(entry_count);
+            for (uint32_t i = 0; i < entry_count; ++i, p += 12) {
+                /* sample_description_index is not needed - only one avc entry is supported */
+                table.stsc[i].first_chunk = mp4_be32(p);
+                table.stsc[i].samples_per_chunk = mp4_be32(p + 4);
+            }
+            return true;
+        }
+
+        default:
+            /* 'mdat' and all other boxes are skipped without being touched */
+            return true;
+    }
+}
+
+bool mp4_demuxer::parse_stsd(const uint8_t* p, std::size_t size, sample_table& table)
+{
+    uint32_t type;
+    std::size_t header_size;
+    std::size_t box_size;
+
+    if (size < MP4_FULL_BOX_HEADER_SIZE + 4)
+        return false;
+
+    /* only the first sample entry is considered */
+    p += MP4_FULL_BOX_HEADER_SIZE + 4;
+    size -= MP4_FULL_BOX_HEADER_SIZE + 4;
+
+    if (!mp4_read_box_header(p, size, type, header_size, box_size))
+        return false;
+
+    if ((type != MP4_FOURCC('a', 'v', 'c', '1')) && (type != MP4_FOURCC('a', 'v', 'c', '3')))
+        return true; /* not an AVC track */
+
+    if (box_size < header_size + MP4_VISUAL_SAMPLE_ENTRY_SIZE)
+        return false;
+
+    p += header_size + MP4_VISUAL_SAMPLE_ENTRY_SIZE;
+    size = box_size - header_size - MP4_VISUAL_SAMPLE_ENTRY_SIZE;
+
+    while (size >= MP4_BOX_HEADER_SIZE) {
+        if (!mp4_read_box_header(p, size, type, header_size, box_size))
+            return false;
+
+        if (MP4_FOURCC('a', 'v', 'c', 'C') == type) {
+            table.avcc = p + header_size;
+            table.avcc_size = box_size - header_size;
+            break;
+        }
+
+        p += box_size;
+        size -= box_size;
+    }
+
+    return true;
+}
+
+bool mp4_demuxer::build_samples(const sample_table& table)
+{
+    const uint32_t sample_count = table.stsz_sample_count;
+    uint32_t number = 1;
+    std::size_t e = 0;
+
+    m_samples.clear();
+    m_samples.reserve(sample_count);
+
+    /* 8.7.4 Sample To Chunk Box - every entry applies up to the first_chunk of the next one */
+    for (uint32_t chunk = 1; (chunk <= table.stco.size()) && (number <= sample_count); ++chunk) {
+        uint64_t offset = table.stco[chunk - 1];
+        uint32_t samples_per_chunk;
+
+        while ((e + 1 < table.stsc.size()) && (table.stsc[e + 1].first_chunk <= chunk))
+            e++;
+
+        if (e >= table.stsc.size())
+            break;
+
+        samples_per_chunk = table.stsc[e].samples_per_chunk;
+
+        for (uint32_t i = 0; (i < samples_per_chunk) && (number <= sample_count); ++i, ++number) {
+            sample s;
+
+            s.number = number;
+            s.offset = offset;
+            s.size = table.stsz_sample_size ? table.stsz_sample_size : table.stsz[number - 1];
+            s.sync = !table.has_stss;
+
+            offset += s.size;
+
+            /* samples of truncated files are ignored */
+            if ((s.offset > m_file_size) || (s.size > m_file_size - s.offset))
+                continue;
+
+            m_samples.push_back(s);
+        }
+    }
+
+    if (table.has_stss) {
+        /* both lists are sorted by sample number */
+        std::size_t i = 0;
+        for (uint32_t sync_number : table.stss) {
+            while ((i < m_samples.size()) && (m_samples[i].number < sync_number))
+                i++;
+            if ((i < m_samples.size()) && (m_samples[i].number == sync_number))
+                m_samples[i].sync = true;
+        }
+    }
+
+    m_number_of_sync_samples = 0;
+    for (const auto& s : m_samples)
+        if (s.sync)
+            m_number_of_sync_samples++;
+
+    m_track_id = table.track_id;
+    m_avcc = table.avcc;
+    m_avcc_size = table.avcc_size;
+
+    return true;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
+static bool mp4_read_box_header(const uint8_t* p, std::size_t available,
+    uint32_t& type, std::size_t& header_size, std::size_t& box_size)
+{
+    uint64_t size;
+
+    if (available < MP4_BOX_HEADER_SIZE)
+        return false;
+
+    size = mp4_be32(p);
+    type = mp4_be32(p + 4);
+    header_size = MP4_BOX_HEADER_SIZE;
+
+    if (1 == size) {
+        /* largesize */
+        if (available < MP4_BOX_HEADER_SIZE + 8)
+            return false;
+        size = mp4_be64(p + 8);
+        header_size += 8;
+    }
+    else
+    if (0 == size) {
+        /* box extends to the end of the file */
+        size = available;
+    }
+
+    if ((size < header_size) || (size > available))
+        return false;
+
+    box_size = size;
+
+    return true;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file mp4_demuxer.hpp
+ *
+ * Definition of ISO/IEC 14496-12 (ISO base media file format, MP4) demuxer.
+ *
+ * Demuxer parses sample tables (moov/trak/mdia/minf/stbl) of the first
+ * AVC video track and gives byte ranges of its samples, so that
+ * sync samples (key frames) can be read without touching the rest
+ * of the file.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _MP4_DEMUXER_HPP_
+#define _MP4_DEMUXER_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define MP4_FOURCC(a, b, c, d) \
+    ((static_cast<uint32_t>(a) << 24) | (static_cast<uint32_t>(b) << 16) | \
+     (static_cast<uint32_t>(c) <<  8) | (static_cast<uint32_t>(d) <<  0))
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+class mp4_demuxer
+{
+public:
+    struct sample
+    {
+        uint32_t number;     /* 1-based, as in the sample tables */
+        uint64_t offset;     /* file offset of the first byte */
+        uint32_t size;
+        bool sync;
+    };
+
+    explicit mp4_demuxer();
+    ~mp4_demuxer();
+
+    mp4_demuxer(const mp4_demuxer&) = delete;
+    mp4_demuxer(mp4_demuxer&&) = delete;
+    mp4_demuxer& operator = (const mp4_demuxer&) = delete;
+    mp4_demuxer& operator = (mp4_demuxer&&) = delete;
+
+    /**
+     * Parses box structure of the whole file (only box headers are touched,
+     * apart from the moov box) and builds sample list of the first
+     * AVC ('avc1'/'avc3') video track.
+     *
+     * @param[in] data Pointer to the first byte of the file (e.g. mapped_file).
+     * @param[in] size Size of the file.
+     *
+     * @return true on success, false if no usable track has been found.
+     */
+    bool open(const uint8_t* data, std::size_t size);
+
+    void reset();
+
+    /**
+     * @return Pointer to AVCDecoderConfigurationRecord (avcC box payload)
+     *         of the track. It points into the data given to open().
+     */
+    const uint8_t* get_avcc() const
+    {
+        return m_avcc;
+    }
+
+    std::size_t get_avcc_size() const
+    {
+        return m_avcc_size;
+    }
+
+    const std::vector<sample>& get_samples() const
+    {
+        return m_samples;
+    }
+
+    /**
+     * @return Sync samples only (all samples if track has no stss box).
+     */
+    std::vector<sample> get_sync_samples() const;
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "mp4_demuxer@";
+        stream << std::hex << this;
+        stream << " [track_id: ";
+        stream << std::dec << m_track_id;
+        stream << ", samples: ";
+        stream << std::dec << m_samples.size();
+        stream << ", sync samples: ";
+        stream << std::dec << m_number_of_sync_samples;
+        stream << ", avcc size: ";
+        stream << std::dec << m_avcc_size;
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    /* sample table of the track being currently parsed */
+    struct sample_table
+    {
+        uint32_t track_id;
+        uint32_t handler_type;
+        const uint8_t* avcc;
+        std::size_t avcc_size;
+        bool has_stss;
+        std::vector<uint32_t> stss;
+        uint32_t stsz_sample_size;
+        uint32_t stsz_sample_count;
+        std::vector<uint32_t> stsz;
+        std::vector<uint64_t> stco;
+        struct stsc_entry
+        {
+            uint32_t first_chunk;
+            uint32_t samples_per_chunk;
+        };
+        std::vector<stsc_entry> stsc;
+    };
+
+    bool parse_boxes(const uint8_t* p, std::size_t size, sample_table& table);
+    bool parse_box(uint32_t type, const uint8_t* p, std::size_t size, sample_table& table);
+    bool parse_stsd(const uint8_t* p, std::size_t size, sample_table& table);
+    bool build_samples(const sample_table& table);
+
+    uint32_t m_track_id;
+    const uint8_t* m_avcc;
+    std::size_t m_avcc_size;
+    std::vector<sample> m_samples;
+    std::size_t m_number_of_sync_samples;
+    std::size_t m_file_size;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _MP4_DEMUXER_HPP_ */
@@ -0,0 +1,302 @@
+/**
+ * @file mpeg2ts_demux.cpp
+ *
+ * MPEG2 transport stream to elementary stream demultiplexer.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <cstring>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "mpeg2ts_demux.hpp"
+#include "mpeg2ts_parser.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+mpeg2ts_demux::mpeg2ts_demux(uint16_t pid, const es_function& es, const discard_function& discard) :
+    m_pid(pid),
+    m_es(es),
+    m_discard(discard),
+    m_random_access_only(false)
+{
+    reset();
+}
+
+mpeg2ts_demux::~mpeg2ts_demux()
+{
+}
+
+void mpeg2ts_demux::reset()
+{
+    m_state = state_e::IDLE;
+    m_buffer_bytes = 0;
+
+    m_random_access_seen = false;
+    m_skipping = false;
+
+    m_cc_valid = false;
+    m_cc = 0;
+    m_damaged = false;
+    m_cc_errors = 0;
+    m_lost_tspackets = 0;
+    m_duplicate_tspackets = 0;
+    m_damaged_pes_packets = 0;
+}
+
+void mpeg2ts_demux::discontinuity()
+{
+    m_state = state_e::IDLE;
+    m_buffer_bytes = 0;
+    m_skipping = false;
+    m_cc_valid = false;
+    m_damaged = false;
+}
+
+void mpeg2ts_demux::push(const uint8_t* tspacket)
+{
+    if (mpeg2ts_parser_get_pid(tspacket) != m_pid)
+        return;
+
+    const unsigned int payload_offset = mpeg2ts_parser_get_payload_offset(tspacket);
+    if (0 == payload_offset)
+        return;
+
+    const bool payload_unit_start_indicator = mpeg2ts_parser_get_payload_unit_start_indicator(tspacket);
+
+    if (!check_continuity(tspacket))
+        return; /* duplicate */
+
+    if (m_damaged) {
+        if (!payload_unit_start_indicator)
+            return;
+        m_damaged = false;
+    }
+
+    if (m_random_access_only && payload_unit_start_indicator) {
+        if (mpeg2ts_parser_get_random_access_indicator(tspacket) ||
+            mpeg2ts_parser_get_es_priority_indicator(tspacket)) {
+            m_random_access_seen = true;
+            m_skipping = false;
+        }
+        else
+            m_skipping = m_random_access_seen;
+
+        if (m_skipping)
+            m_state = state_e::IDLE;
+    }
+
+    if (m_skipping)
+        return;
+
+    demux(tspacket + payload_offset, MPEG2TS_PARSER_PACKET_SIZE - payload_offset, payload_unit_start_indicator);
+}
+
+void mpeg2ts_demux::push(const uint8_t* data, std::size_t count, std::size_t tspacket_size)
+{
+    std::size_t n = 0;
+
+    /* Bytes not starting a ts packet (e.g. at the beginning of a file) are skipped.
+       Sync byte of the next packet is expected tspacket_size bytes further
+       (behind TP_extra_header of m2ts or Reed-Solomon bytes of 204/208 bytes packets). */
+    while (n + MPEG2TS_PARSER_PACKET_SIZE <= count) {
+        if (data[n] != MPEG2TS_PARSER_SYNC_BYTE) {
+            n++;
+            continue;
+        }
+
+        push(data + n);
+
+        n += tspacket_size;
+    }
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+
+/* returns false for duplicate ts packet which shall be dropped */
+bool mpeg2ts_demux::check_continuity(const uint8_t* tspacket)
+{
+    const unsigned int cc = mpeg2ts_parser_get_continuity_counter(tspacket);
+    const unsigned int expected = (m_cc + 1) & 0x0f;
+    const bool valid = m_cc_valid;
+
+    m_cc_valid = true;
+
+    if (!valid || mpeg2ts_parser_get_discontinuity_indicator(tspacket) || (cc == expected)) {
+        m_cc = cc;
+        return true;
+    }
+
+    if (cc == m_cc) {
+        /* the same packet may be sent twice in a row */
+        m_duplicate_tspackets++;
+        return false;
+    }
+
+    m_cc_errors++;
+    m_lost_tspackets += (cc - expected) & 0x0f;
+    m_cc = cc;
+
+    /* rest of the PES packet (and NAL unit being assembled from it) is torn */
+    if (!m_damaged && (m_state != state_e::IDLE)) {
+        m_damaged_pes_packets++;
+        if (m_discard)
+            m_discard();
+    }
+    m_damaged = true;
+    m_state = state_e::IDLE;
+    m_buffer_bytes = 0;
+
+    return true;
+}
+
+void mpeg2ts_demux::demux(const uint8_t* tspayload, std::size_t count, bool payload_unit_start_indicator)
+{
+    const uint8_t* p;
+    std::size_t available;
+    std::size_t len;
+
+#define NEEDBYTES(x)                                                       \
+    do {                                                                   \
+        int missing;                                                       \
+                                                                           \
+        missing = (x) - available;                                         \
+        if (missing > 0) {                                                 \
+            if (0 == m_buffer_bytes) {                                     \
+                memcpy(m_buffer, p, available);                            \
+                m_buffer_bytes = available;                                \
+                return;                                                    \
+            }                                                              \
+            else {                                                         \
+                if ((unsigned int)missing <= count) {                      \
+                    memcpy(m_buffer + m_buffer_bytes, tspayload, missing); \
+                    m_buffer_bytes += missing;                             \
+                    tspayload += missing;                                  \
+                    count -= missing;                                      \
+                    available = (x);                                       \
+                }                                                          \
+                else {                                                     \
+                    memcpy(m_buffer + m_buffer_bytes, tspayload, count);   \
+                    m_buffer_bytes += count;                               \
+                    return;                                                \
+                }                                                          \
+            }                                                              \
+        }                                                                  \
+    } while (0)
+
+    if (payload_unit_start_indicator) {
+        m_state = state_e::HEADER;
+        m_buffer_bytes = 0;
+    }
+
+    if (0 == m_buffer_bytes) {
+        p = tspayload;
+        available = count;
+    }
+    else {
+        p = m_buffer;
+        available = m_buffer_bytes;
+    }
+
+    switch (m_state) {
+        case state_e::IDLE:
+            return;
+
+        case state_e::HEADER:
+            NEEDBYTES(7);
+
+            /* 1110 xxxx - 13818-2 or 11172-2 video stream number xxxxx */
+            if ((p[0] != 0x00) || (p[1] != 0x00) || (p[2] != 0x01) ||
+                (p[3] <  0xe0) || (p[3] >  0xef) || ((p[6] & 0xc0) != 0x80 /* mpeg2 */)) {
+                m_state = state_e::IDLE;
+                return;
+            }
+
+            NEEDBYTES(9);
+            len = 9 + p[8];
+            NEEDBYTES(len);
+
+            if (m_timestamp) {
+                uint64_t pts, dts;
+
+                if (mpeg2ts_parser_get_pes_pts(p, pts)) {
+                    if (!mpeg2ts_parser_get_pes_dts(p, dts))
+                        dts = pts;
+                    m_timestamp(pts, dts);
+                }
+            }
+
+            if (0 == m_buffer_bytes) {
+                tspayload += len;
+                count -= len;
+            }
+
+            m_es(tspayload, count);
+            m_state = state_e::DATA;
+            return;
+
+        case state_e::DATA:
+            m_es(tspayload, count);
+            return;
+    }
+
+#undef NEEDBYTES
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
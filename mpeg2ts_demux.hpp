@@ -0,0 +1,235 @@
+/**
+ * @file mpeg2ts_demux.hpp
+ *
+ * Definition of MPEG2 transport stream to elementary stream demultiplexer.
+ *
+ * Demultiplexer extracts payload of PES packets carried by ts packets
+ * of one pid and hands it over to the user. All its state is kept
+ * in the object, so any number of them may work in one process
+ * (one per stream, each one used by one thread at a time).
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _MPEG2TS_DEMUX_HPP_
+#define _MPEG2TS_DEMUX_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <functional> /* for std::function */
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+/* PES packet header is collected before it is parsed, 9 bytes + PES_header_data_length */
+#define MPEG2TS_DEMUX_MAX_PES_HEADER_SIZE   (9 + 255)
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+class mpeg2ts_demux
+{
+public:
+    /**
+     * Function receiving payload of PES packets (elementary stream bytes).
+     */
+    typedef std::function<void(const uint8_t* data, std::size_t count)> es_function;
+
+    /**
+     * Function informed that elementary stream bytes delivered since
+     * the beginning of the current PES packet are torn and shall be dropped.
+     */
+    typedef std::function<void()> discard_function;
+
+    /**
+     * Function informed about PTS and DTS (equal to PTS if not sent)
+     * of the PES packet which payload is to be delivered next.
+     */
+    typedef std::function<void(uint64_t pts, uint64_t dts)> timestamp_function;
+
+    explicit mpeg2ts_demux(uint16_t pid, const es_function& es, const discard_function& discard);
+    ~mpeg2ts_demux();
+
+    mpeg2ts_demux(const mpeg2ts_demux&) = delete;
+    mpeg2ts_demux(mpeg2ts_demux&&) = delete;
+    mpeg2ts_demux& operator = (const mpeg2ts_demux&) = delete;
+    mpeg2ts_demux& operator = (mpeg2ts_demux&&) = delete;
+
+    /**
+     * Forgets the PES packet being demultiplexed and clears the counters,
+     * so that the demultiplexer can be reused for another (unrelated) stream.
+     */
+    void reset();
+
+    /**
+     * Informs that next ts packets do not follow the previous ones
+     * (e.g. after a seek). PES packet being demultiplexed is dropped,
+     * but it is not counted as a continuity error.
+     */
+    void discontinuity();
+
+    uint16_t get_pid() const
+    {
+        return m_pid;
+    }
+
+    /**
+     * Passes only PES packets starting in ts packets with random_access_indicator
+     * or elementary_stream_priority_indicator set (once the stream has signalled
+     * any of them), so that the user is not even given other pictures.
+     */
+    void set_random_access_only(bool random_access_only)
+    {
+        m_random_access_only = random_access_only;
+    }
+
+    /**
+     * Sets function informed about timestamps of PES packets.
+     * PES packets without PTS are not reported.
+     */
+    void set_timestamp_function(const timestamp_function& timestamp)
+    {
+        m_timestamp = timestamp;
+    }
+
+    /**
+     * Consumes one ts packet (packets of other pids are ignored).
+     */
+    void push(const uint8_t* tspacket);
+
+    /**
+     * Consumes ts packets laid tspacket_size bytes apart (e.g. a range of a file),
+     * starting with the first sync byte. No synchronization is required,
+     * so a range may be as short as one ts packet.
+     */
+    void push(const uint8_t* data, std::size_t count, std::size_t tspacket_size);
+
+    std::size_t get_cc_errors() const
+    {
+        return m_cc_errors;
+    }
+
+    std::size_t get_lost_tspackets() const
+    {
+        return m_lost_tspackets;
+    }
+
+    std::size_t get_duplicate_tspackets() const
+    {
+        return m_duplicate_tspackets;
+    }
+
+    std::size_t get_damaged_pes_packets() const
+    {
+        return m_damaged_pes_packets;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "mpeg2ts_demux@";
+        stream << std::hex << this;
+        stream << " [pid: ";
+        stream << std::dec << m_pid;
+        stream << ", cc errors: ";
+        stream << std::dec << m_cc_errors;
+        stream << ", lost: ";
+        stream << std::dec << m_lost_tspackets;
+        stream << ", duplicates: ";
+        stream << std::dec << m_duplicate_tspackets;
+        stream << ", damaged PES packets: ";
+        stream << std::dec << m_damaged_pes_packets;
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    enum class state_e
+    {
+        IDLE,   /* waiting for the beginning of next PES packet */
+        HEADER, /* collecting PES packet header */
+        DATA,   /* passing payload */
+    };
+
+    bool check_continuity(const uint8_t* tspacket);
+    void demux(const uint8_t* tspayload, std::size_t count, bool payload_unit_start_indicator);
+
+    uint16_t m_pid;
+    es_function m_es;
+    discard_function m_discard;
+    timestamp_function m_timestamp;
+
+    state_e m_state;
+    std::size_t m_buffer_bytes;
+    uint8_t m_buffer[MPEG2TS_DEMUX_MAX_PES_HEADER_SIZE];
+
+    /* random access points (see set_random_access_only()) */
+    bool m_random_access_only;
+    bool m_random_access_seen; /* stream signals random access points at all */
+    bool m_skipping;
+
+    /* continuity_counter tracking, PES packet with a gap is dropped */
+    bool m_cc_valid;
+    unsigned int m_cc;
+    bool m_damaged;
+    std::size_t m_cc_errors;
+    std::size_t m_lost_tspackets;
+    std::size_t m_duplicate_tspackets;
+    std::size_t m_damaged_pes_packets;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _MPEG2TS_DEMUX_HPP_ */
@@ -18,6 +18,9 @@
 /*===========================================================================*\
  * system header files
 \*===========================================================================*/
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*===========================================================================*\
  * project header files
@@ -33,9 +36,9 @@ using namespace ymn;
 /*===========================================================================*\
  * preprocessor #define constants and macros
 \*===========================================================================*/
-#define MPEG2TS_PARSER_SYNC_BYTE                     0x47
 #define MPEG2TS_PARSER_FORWARD_SCAN                    10
 #define MPEG2TS_PARSER_NO_SYNC_INDICATOR               -1
+#define MPEG2TS_PARSER_SCAN_LANES                      16
 
 #define MPEG2TS_PARSER_PACKET_SIZE_EXTENSIONS \
     X(REED_SOLOMON_CODE_LENGTH_DVB,  16) \
@@ -69,6 +72,7 @@ enum mpeg2ts_parser_packet_size_extensions
 \*===========================================================================*/
 static constexpr std::size_t mpeg2ts_parser_packet_sizes[] = {
     MPEG2TS_PARSER_PACKET_SIZE,
+    MPEG2TS_PARSER_M2TS_PACKET_SIZE,
 #define X(a, b) MPEG2TS_PARSER_PACKET_SIZE + a,
     MPEG2TS_PARSER_PACKET_SIZE_EXTENSIONS
 #undef X
@@ -91,9 +95,52 @@ static constexpr std::size_t mpeg2ts_parser_bigest_packet_size()
     return max;
 }
 
+/* number of candidate offsets examined by one resynchronization attempt */
+static constexpr std::size_t mpeg2ts_parser_scan_window()
+{
+    return (mpeg2ts_parser_bigest_packet_size() + MPEG2TS_PARSER_SCAN_LANES - 1) /
+        MPEG2TS_PARSER_SCAN_LANES * MPEG2TS_PARSER_SCAN_LANES;
+}
+
+/* bit n is set if p[n] is a sync byte (n < MPEG2TS_PARSER_SCAN_LANES) */
+static inline uint32_t mpeg2ts_parser_sync_mask(const uint8_t* p)
+{
+#if defined(__SSE2__)
+    const __m128i sync = _mm_set1_epi8(MPEG2TS_PARSER_SYNC_BYTE);
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, sync)));
+#else
+    uint32_t mask = 0;
+    for (std::size_t n = 0; n < MPEG2TS_PARSER_SCAN_LANES; ++n)
+        mask |= static_cast<uint32_t>(p[n] == MPEG2TS_PARSER_SYNC_BYTE) << n;
+    return mask;
+#endif
+}
+
 /*===========================================================================*\
  * public function definitions
 \*===========================================================================*/
+std::size_t mpeg2ts_parser::get_tspackets(const uint8_t* tspackets[], std::size_t max_tspackets)
+{
+    std::size_t n = 0;
+    const uint8_t *tsp = m_flatbuffer.read_ptr() + m_tspacket_header_size;
+    const uint8_t *end = m_flatbuffer.read_ptr() + m_flatbuffer.read_available() + m_tspacket_header_size;
+
+    for (; (n < max_tspackets) && (static_cast<std::size_t>(end - tsp) >= m_tspacket_size); tsp += m_tspacket_size) {
+        if (MPEG2TS_PARSER_SYNC_BYTE != *tsp)
+            break;
+
+        if (!m_transport_rate.is_valid())
+            m_transport_rate.calculate(tsp);
+
+        if (m_pid_filter.test(mpeg2ts_parser_get_pid(tsp)))
+            tspackets[n++] = tsp;
+    }
+
+    m_flatbuffer.consume(tsp - m_flatbuffer.read_ptr() - m_tspacket_header_size);
+
+    return n;
+}
 
 /*===========================================================================*\
  * protected function definitions
@@ -102,56 +149,121 @@ static constexpr std::size_t mpeg2ts_parser_bigest_packet_size()
 /*===========================================================================*\
  * private function definitions
 \*===========================================================================*/
-int mpeg2ts_parser::synchronize(const std::size_t tspacket_size)
+/*
+ * Examines all offsets of the scan window for all packet sizes in one pass.
+ * Sync bytes are searched for MPEG2TS_PARSER_SCAN_LANES offsets at once,
+ * and every packet size is then verified for all lanes of the block together.
+ * Offsets are examined in increasing order, at every offset packet size
+ * used before the loss of synchronization is preferred. Returns offset
+ * of the packet (of its TP_extra_header for m2ts, which is skipped
+ * if it is not available) and sets tspacket_size on success, returns MPEG2TS_PARSER_NO_SYNC_INDICATOR
+ * and leaves tspacket_size as 0 if more bytes are needed to decide
+ * (or sets it to SIZE_MAX if there is no sync within the whole window).
+ */
+int mpeg2ts_parser::synchronize(std::size_t& tspacket_size)
 {
-    int offset;
-    std::size_t i, j;
-    const uint8_t *p;
-
-    offset = MPEG2TS_PARSER_NO_SYNC_INDICATOR;
-    p = m_flatbuffer.read_ptr();
-
-    for (i = 0;
-        ((i < tspacket_size) && (MPEG2TS_PARSER_NO_SYNC_INDICATOR == offset));
-        ++i) {
-        if (p[i] != MPEG2TS_PARSER_SYNC_BYTE) continue;
-        offset = static_cast<int>(i);
-        for (j = 1; j <= MPEG2TS_PARSER_FORWARD_SCAN; ++j) {
-            if (p[j * tspacket_size + offset] != MPEG2TS_PARSER_SYNC_BYTE) {
-                offset = MPEG2TS_PARSER_NO_SYNC_INDICATOR;
-                break;
+    std::size_t sizes[mpeg2ts_parser_packet_sizes_elements];
+    std::size_t n, elements = 0;
+    const uint8_t *p = m_flatbuffer.read_ptr();
+    const std::size_t available = m_flatbuffer.read_available();
+
+    if (m_previous_tspacket_size)
+        sizes[elements++] = m_previous_tspacket_size;
+    for (n = 0; n < mpeg2ts_parser_packet_sizes_elements; ++n)
+        if (mpeg2ts_parser_packet_sizes[n] != m_previous_tspacket_size)
+            sizes[elements++] = mpeg2ts_parser_packet_sizes[n];
+
+    tspacket_size = 0;
+
+    if (available < mpeg2ts_parser_scan_window())
+        return MPEG2TS_PARSER_NO_SYNC_INDICATOR;
+
+    for (std::size_t block = 0; block < mpeg2ts_parser_scan_window(); block += MPEG2TS_PARSER_SCAN_LANES) {
+        uint32_t candidates = mpeg2ts_parser_sync_mask(p + block);
+        if (!candidates)
+            continue;
+
+        uint32_t confirmed[mpeg2ts_parser_packet_sizes_elements];
+        uint32_t unknown[mpeg2ts_parser_packet_sizes_elements];
+
+        for (n = 0; n < elements; ++n) {
+            const std::size_t span = MPEG2TS_PARSER_FORWARD_SCAN * sizes[n];
+
+            confirmed[n] = candidates;
+            unknown[n] = 0;
+
+            if (block + span + MPEG2TS_PARSER_SCAN_LANES <= available) {
+                for (std::size_t j = 1; (j <= MPEG2TS_PARSER_FORWARD_SCAN) && confirmed[n]; ++j)
+                    confirmed[n] &= mpeg2ts_parser_sync_mask(p + block + j * sizes[n]);
+            }
+            else {
+                /* end of data within the block, verify lanes one by one */
+                for (std::size_t lane = 0; lane < MPEG2TS_PARSER_SCAN_LANES; ++lane) {
+                    const uint32_t bit = 1U << lane;
+                    if (!(candidates & bit))
+                        continue;
+                    if (block + lane + span >= available) {
+                        confirmed[n] &= ~bit;
+                        unknown[n] |= bit;
+                        continue;
+                    }
+                    for (std::size_t j = 1; j <= MPEG2TS_PARSER_FORWARD_SCAN; ++j) {
+                        if (p[block + lane + j * sizes[n]] != MPEG2TS_PARSER_SYNC_BYTE) {
+                            confirmed[n] &= ~bit;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (std::size_t lane = 0; lane < MPEG2TS_PARSER_SCAN_LANES; ++lane) {
+            const uint32_t bit = 1U << lane;
+            if (!(candidates & bit))
+                continue;
+            for (n = 0; n < elements; ++n) {
+                if (unknown[n] & bit)
+                    return MPEG2TS_PARSER_NO_SYNC_INDICATOR;
+                if (confirmed[n] & bit) {
+                    std::size_t offset = block + lane;
+                    if (MPEG2TS_PARSER_M2TS_PACKET_SIZE == sizes[n])
+                        offset = (offset >= MPEG2TS_PARSER_M2TS_HEADER_SIZE) ?
+                            offset - MPEG2TS_PARSER_M2TS_HEADER_SIZE : offset + MPEG2TS_PARSER_PACKET_SIZE;
+                    tspacket_size = sizes[n];
+                    return static_cast<int>(offset);
+                }
             }
         }
     }
 
-    return offset;
+    tspacket_size = SIZE_MAX;
+
+    return MPEG2TS_PARSER_NO_SYNC_INDICATOR;
 }
 
 mpeg2ts_parser_status_e mpeg2ts_parser::waiting_for_sync()
 {
-    mpeg2ts_parser_status_e status = mpeg2ts_parser_status_e::NOT_SYNCHRONIZED;
-
-    for (std::size_t n = 0; n < mpeg2ts_parser_packet_sizes_elements; ++n) {
-        int offset;
-        std::size_t packet_size = mpeg2ts_parser_packet_sizes[n];
-
-        if (m_flatbuffer.read_available() < (packet_size * (MPEG2TS_PARSER_FORWARD_SCAN + 1))) {
-            status = mpeg2ts_parser_status_e::NEED_BYTES;
-            break;
-        }
+    mpeg2ts_parser_status_e status;
+    std::size_t packet_size;
+    int offset;
 
-        offset = synchronize(packet_size);
-        if (MPEG2TS_PARSER_NO_SYNC_INDICATOR != offset) {
-            m_flatbuffer.consume(offset);
-            m_state_function = &mpeg2ts_parser::synchronized;
-            m_tspacket_size = packet_size;
-            status = mpeg2ts_parser_status_e::SYNC_GAINED;
-            break;
-        }
+    offset = synchronize(packet_size);
+    if (MPEG2TS_PARSER_NO_SYNC_INDICATOR != offset) {
+        m_flatbuffer.consume(offset);
+        m_state_function = &mpeg2ts_parser::synchronized;
+        m_tspacket_size = packet_size;
+        m_tspacket_header_size = (MPEG2TS_PARSER_M2TS_PACKET_SIZE == packet_size) ? MPEG2TS_PARSER_M2TS_HEADER_SIZE : 0;
+        m_previous_tspacket_size = packet_size;
+        status = mpeg2ts_parser_status_e::SYNC_GAINED;
     }
-
-    if (mpeg2ts_parser_status_e::NOT_SYNCHRONIZED == status)
-        m_flatbuffer.consume(MPEG2TS_PARSER_PACKET_SIZE);
+    else
+    if (SIZE_MAX == packet_size) {
+        /* every offset of the window has been examined for every packet size */
+        m_flatbuffer.consume(mpeg2ts_parser_scan_window());
+        status = mpeg2ts_parser_status_e::NOT_SYNCHRONIZED;
+    }
+    else
+        status = mpeg2ts_parser_status_e::NEED_BYTES;
 
     return status;
 }
@@ -163,16 +275,21 @@ mpeg2ts_parser_status_e mpeg2ts_parser::synchronized()
 
     mpeg2ts_parser_status_e status = mpeg2ts_parser_status_e::SYNCHRONIZED;
 
-    const uint8_t *tsp = m_flatbuffer.read_ptr();
+    const uint8_t *tsp = m_flatbuffer.read_ptr() + m_tspacket_header_size;
     if (MPEG2TS_PARSER_SYNC_BYTE == *tsp) {
-        if (!m_transport_rate.is_valid())
-            if (m_transport_rate.calculate(tsp))
-                status = mpeg2ts_parser_status_e::TRANSPORT_RATE_DETECTED;
+        /* rate is calculated from packets consumed by get_tspacket(s)(),
+           as the packet is not consumed here, it would be counted twice */
+        if (m_transport_rate.is_valid() && !m_transport_rate_reported) {
+            m_transport_rate_reported = true;
+            status = mpeg2ts_parser_status_e::TRANSPORT_RATE_DETECTED;
+        }
     }
     else {
         m_state_function = &mpeg2ts_parser::waiting_for_sync;
         m_tspacket_size = 0;
+        m_tspacket_header_size = 0;
         m_transport_rate.reset();
+        m_transport_rate_reported = false;
         status = mpeg2ts_parser_status_e::SYNC_LOST;
     }
 
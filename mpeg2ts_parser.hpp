@@ -28,6 +28,7 @@
 #include <string>
 #include <sstream>
 #include <functional>
+#include <bitset>
 
 #include <cstring>
 #include <climits>
@@ -46,6 +47,13 @@
  * preprocessor #define constants and macros
 \*===========================================================================*/
 #define MPEG2TS_PARSER_PACKET_SIZE       188
+#define MPEG2TS_PARSER_SYNC_BYTE         0x47
+
+/* BDAV MPEG-2 transport stream (.m2ts) precedes every ts packet with 4 bytes long TP_extra_header */
+#define MPEG2TS_PARSER_M2TS_HEADER_SIZE  4
+#define MPEG2TS_PARSER_M2TS_PACKET_SIZE  (MPEG2TS_PARSER_M2TS_HEADER_SIZE + MPEG2TS_PARSER_PACKET_SIZE)
+
+#define MPEG2TS_PARSER_NO_ARRIVAL_TIME_STAMP UINT32_MAX
 
 #define MPEG2TS_PARSER_STATUSES \
     MPEG2TS_PARSER_STATUS(NEED_BYTES) \
@@ -66,6 +74,13 @@ static inline mpeg2ts_pid mpeg2ts_parser_get_pid(const uint8_t* tsp)
    return mpeg2ts_pid(((tsp[1] << 8) + tsp[2]) & 0x1fff);
 }
 
+/* 30 bits arrival_time_stamp (27MHz) of TP_extra_header */
+static inline uint32_t mpeg2ts_parser_get_arrival_time_stamp(const uint8_t* tp_extra_header)
+{
+   return ((tp_extra_header[0] << 24) | (tp_extra_header[1] << 16) |
+           (tp_extra_header[2] << 8) | tp_extra_header[3]) & 0x3fffffff;
+}
+
 static inline bool mpeg2ts_parser_has_pcr(const uint8_t* tsp)
 {
    return ((tsp[3] & 0x20)  &&  // if adaptation field is present
@@ -75,10 +90,92 @@ static inline bool mpeg2ts_parser_has_pcr(const uint8_t* tsp)
 
 static inline uint64_t mpeg2ts_parser_get_pcr(const uint8_t* tsp)
 {
-   uint64_t pcr_base = (((uint64_t)((tsp[6] << 24) + (tsp[7] << 16) + (tsp[8] << 8) + tsp[9]) << 8) | tsp[10]) >> 7;
+   uint64_t pcr_base = (((uint64_t)(((uint32_t)tsp[6] << 24) + (tsp[7] << 16) + (tsp[8] << 8) + tsp[9]) << 8) | tsp[10]) >> 7;
    return 1ULL + pcr_base * 300 + (((tsp[10] << 8) | tsp[11]) & 0x1ff);
 }
 
+/* discontinuity_indicator of the adaptation field (false if there is no adaptation field) */
+static inline bool mpeg2ts_parser_get_discontinuity_indicator(const uint8_t* tsp)
+{
+   return ((tsp[3] & 0x20) && (tsp[4]) && (tsp[5] & 0x80));
+}
+
+static inline unsigned int mpeg2ts_parser_get_continuity_counter(const uint8_t* tsp)
+{
+   return tsp[3] & 0x0f;
+}
+
+/* random_access_indicator of the adaptation field (false if there is no adaptation field) */
+static inline bool mpeg2ts_parser_get_random_access_indicator(const uint8_t* tsp)
+{
+   return ((tsp[3] & 0x20) && (tsp[4]) && (tsp[5] & 0x40));
+}
+
+/* elementary_stream_priority_indicator of the adaptation field (false if there is no adaptation field) */
+static inline bool mpeg2ts_parser_get_es_priority_indicator(const uint8_t* tsp)
+{
+   return ((tsp[3] & 0x20) && (tsp[4]) && (tsp[5] & 0x20));
+}
+
+static inline bool mpeg2ts_parser_get_payload_unit_start_indicator(const uint8_t* tsp)
+{
+   return tsp[1] & 0x40;
+}
+
+/* returns offset to the first byte of the payload or 0 if payload is not present */
+static inline unsigned int mpeg2ts_parser_get_payload_offset(const uint8_t* tsp)
+{
+   // 00 - reserved for future use by ISO/IEC
+   // ITU-T Rec. H.222.0 | ISO/IEC 13818-1 decoders shall discard Transport Stream packets
+   // with the adaptation_field_control field set to a value of '00'.
+   // 01 - no adaptation_field, payload only
+   // 10 - adaptation_field only, no payload
+   // 11 - adaptation_field followed by payload
+   switch ((tsp[3] >> 4) & 0x03) {
+      case  1: return 4;
+      case  3: return (5 + tsp[4] < MPEG2TS_PARSER_PACKET_SIZE) ? 5 + tsp[4] : 0;
+      default: return 0;
+   }
+}
+
+/* returns size of the PES header of a video stream or 0 if it is not complete/valid */
+static inline std::size_t mpeg2ts_parser_get_pes_header_size(const uint8_t* pes, std::size_t count)
+{
+   /* 1110 xxxx - 13818-2 or 11172-2 video stream number xxxxx */
+   if ((count < 9) ||
+       (pes[0] != 0x00) || (pes[1] != 0x00) || (pes[2] != 0x01) ||
+       (pes[3] <  0xe0) || (pes[3] >  0xef) || ((pes[6] & 0xc0) != 0x80 /* mpeg2 */))
+      return 0;
+
+   return (count >= 9U + pes[8]) ? 9U + pes[8] : 0;
+}
+
+/* PTS (33 bits, 90kHz) of PES header, if present */
+static inline bool mpeg2ts_parser_get_pes_pts(const uint8_t* pes, uint64_t& pts)
+{
+   if (!(pes[7] & 0x80) || (pes[8] < 5))
+      return false;
+
+   pts = ((uint64_t)((pes[9] >> 1) & 0x07) << 30) |
+         ((uint64_t)pes[10] << 22) | ((uint64_t)(pes[11] >> 1) << 15) |
+         ((uint64_t)pes[12] << 7) | (pes[13] >> 1);
+
+   return true;
+}
+
+/* DTS (33 bits, 90kHz) of PES header, if present (PTS_DTS_flags equal to '11') */
+static inline bool mpeg2ts_parser_get_pes_dts(const uint8_t* pes, uint64_t& dts)
+{
+   if (((pes[7] & 0xc0) != 0xc0) || (pes[8] < 10))
+      return false;
+
+   dts = ((uint64_t)((pes[14] >> 1) & 0x07) << 30) |
+         ((uint64_t)pes[15] << 22) | ((uint64_t)(pes[16] >> 1) << 15) |
+         ((uint64_t)pes[17] << 7) | (pes[18] >> 1);
+
+   return true;
+}
+
 } /* end of namespace ymn */
 
 /*===========================================================================*\
@@ -114,8 +211,13 @@ public:
         base_parser<uint8_t>(capacity),
         m_state_function(&mpeg2ts_parser::waiting_for_sync),
         m_tspacket_size(0),
-        m_transport_rate()
+        m_tspacket_header_size(0),
+        m_previous_tspacket_size(0),
+        m_transport_rate(),
+        m_transport_rate_reported(false),
+        m_pid_filter()
     {
+        m_pid_filter.set();
 #if defined(DEBUG_PARSERS)
         std::cout << __PRETTY_FUNCTION__ << std::endl;
         std::cout << to_string() << std::endl;
@@ -139,7 +241,32 @@ public:
         base_parser::reset();
         m_state_function = &mpeg2ts_parser::waiting_for_sync;
         m_tspacket_size = 0;
+        m_tspacket_header_size = 0;
+        m_previous_tspacket_size = 0;
         m_transport_rate.reset();
+        m_transport_rate_reported = false;
+    }
+
+    /**
+     * Decides whether ts packets of given pid are returned by get_tspackets().
+     * All pids pass by default, the filter is preserved by reset().
+     */
+    void set_pid_filter(uint16_t pid, bool pass)
+    {
+        m_pid_filter.set(pid & MPEG2TS_PID_MAX, pass);
+    }
+
+    void set_pid_filter(bool pass)
+    {
+        if (pass)
+            m_pid_filter.set();
+        else
+            m_pid_filter.reset();
+    }
+
+    bool is_pid_filtered(uint16_t pid) const
+    {
+        return !m_pid_filter.test(pid & MPEG2TS_PID_MAX);
     }
 
     std::string to_string() const
@@ -174,30 +301,68 @@ public:
     {
         const uint8_t *p;
 
-        p = m_flatbuffer.read_ptr();
+        p = m_flatbuffer.read_ptr() + m_tspacket_header_size;
         m_flatbuffer.consume(m_tspacket_size);
 
+        if (!m_transport_rate.is_valid())
+            m_transport_rate.calculate(p);
+
         return p;
     }
 
+    /**
+     * Consumes a run of consecutive ts packets starting with the one
+     * announced by parse() (which must have returned SYNCHRONIZED).
+     * Returned pointers point at ts packets themselves (i.e. after
+     * TP_extra_header of m2ts packets, see get_arrival_time_stamp()).
+     * Packets of pids rejected by the pid filter are dropped without
+     * being reported. The run ends when data is exhausted, when a packet
+     * without sync byte is met (next parse() reports SYNC_LOST)
+     * or when max_tspackets have been stored.
+     *
+     * @param[out] tspackets     Pointers to the accepted ts packets.
+     * @param[in]  max_tspackets Capacity of tspackets.
+     *
+     * @return Number of stored ts packets (may be 0).
+     */
+    std::size_t get_tspackets(const uint8_t* tspackets[], std::size_t max_tspackets);
+
+    /**
+     * Returns size of the packets including extra header or trailer
+     * (188, 192 for m2ts, 204 or 208) or 0 if not synchronized.
+     */
     std::size_t get_tspacket_size() const
     {
         return m_tspacket_size;
     }
 
+    /**
+     * Returns arrival_time_stamp of a packet returned by get_tspacket()
+     * or get_tspackets() (m2ts only), MPEG2TS_PARSER_NO_ARRIVAL_TIME_STAMP otherwise.
+     */
+    uint32_t get_arrival_time_stamp(const uint8_t* tspacket) const
+    {
+        if (MPEG2TS_PARSER_M2TS_HEADER_SIZE != m_tspacket_header_size)
+            return MPEG2TS_PARSER_NO_ARRIVAL_TIME_STAMP;
+
+        return mpeg2ts_parser_get_arrival_time_stamp(tspacket - MPEG2TS_PARSER_M2TS_HEADER_SIZE);
+    }
+
     std::size_t get_tspacket_rate() const
     {
         return m_transport_rate;
     }
 
 private:
-    int synchronize(const std::size_t tspacket_size);
+    int synchronize(std::size_t& tspacket_size);
 
     mpeg2ts_parser_status_e waiting_for_sync();
     mpeg2ts_parser_status_e synchronized();
 
     mpeg2ts_parser_status_e (mpeg2ts_parser::*m_state_function)();
     std::size_t m_tspacket_size;
+    std::size_t m_tspacket_header_size; /* bytes preceding the sync byte */
+    std::size_t m_previous_tspacket_size; /* tried first when synchronization is lost */
 
     struct transport_rate
     {
@@ -240,6 +405,9 @@ private:
     };
 
     transport_rate m_transport_rate;
+    bool m_transport_rate_reported;
+
+    std::bitset<MPEG2TS_PID_MAX + 1> m_pid_filter;
 };
 
 } /* end of namespace ymn */
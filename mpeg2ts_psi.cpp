@@ -0,0 +1,413 @@
+/**
+ * @file mpeg2ts_psi.cpp
+ *
+ * MPEG2 transport stream program specific information tracker.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <algorithm>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "mpeg2ts_psi.hpp"
+#include "mpeg2ts_parser.hpp"
+#include "ioutilities.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+/* table_id .. last_section_number */
+#define MPEG2TS_PSI_SECTION_HEADER_SIZE     8
+#define MPEG2TS_PSI_CRC32_SIZE              4
+
+#define MPEG2TS_PSI_CRC32_POLYNOMIAL        0x04c11db7
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+struct crc32_table
+{
+    crc32_table()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i << 24;
+            for (int k = 0; k < 8; ++k)
+                crc = (crc & 0x80000000) ? (crc << 1) ^ MPEG2TS_PSI_CRC32_POLYNOMIAL : (crc << 1);
+            entries[i] = crc;
+        }
+    }
+
+    uint32_t entries[256];
+};
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+static const crc32_table crc32_lookup;
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+static inline uint16_t get_u16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+uint32_t ymn::mpeg2ts_psi_crc32(const uint8_t* data, std::size_t count)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (std::size_t i = 0; i < count; ++i)
+        crc = (crc << 8) ^ crc32_lookup.entries[(crc >> 24) ^ data[i]];
+
+    return crc;
+}
+
+mpeg2ts_psi::mpeg2ts_psi(const stream_function& function) :
+    m_function(function),
+    m_psi_pids(),
+    m_sections(),
+    m_pat_version(-1),
+    m_pat_sections(),
+    m_pat_programs(),
+    m_programs(),
+    m_crc_errors(0)
+{
+    m_psi_pids.set(MPEG2TS_PSI_PAT_PID);
+}
+
+mpeg2ts_psi::~mpeg2ts_psi()
+{
+}
+
+void mpeg2ts_psi::push(const uint8_t* tspacket)
+{
+    const uint16_t pid = mpeg2ts_parser_get_pid(tspacket);
+    const unsigned int payload_offset = mpeg2ts_parser_get_payload_offset(tspacket);
+
+    if ((0 == payload_offset) || (payload_offset >= MPEG2TS_PARSER_PACKET_SIZE))
+        return;
+
+    section_buffer& sb = m_sections[pid];
+    const uint8_t* p = tspacket + payload_offset;
+    std::size_t count = MPEG2TS_PARSER_PACKET_SIZE - payload_offset;
+
+    if (mpeg2ts_parser_get_payload_unit_start_indicator(tspacket)) {
+        const std::size_t pointer_field = p[0];
+
+        p++;
+        count--;
+
+        if (pointer_field > count) {
+            sb.started = false;
+            sb.data.clear();
+            return;
+        }
+
+        /* bytes preceding the pointed section complete the previous one */
+        if (sb.started)
+            assemble(pid, p, pointer_field);
+
+        sb.started = true;
+        sb.data.clear();
+
+        p += pointer_field;
+        count -= pointer_field;
+    }
+
+    if (sb.started)
+        assemble(pid, p, count);
+}
+
+void mpeg2ts_psi::reset()
+{
+    m_psi_pids.reset();
+    m_psi_pids.set(MPEG2TS_PSI_PAT_PID);
+    m_sections.clear();
+    m_pat_version = -1;
+    m_pat_sections.reset();
+    m_pat_programs.clear();
+    m_programs.clear();
+    m_crc_errors = 0;
+}
+
+std::string mpeg2ts_psi::to_string() const
+{
+    std::ostringstream stream;
+
+    stream << "mpeg2ts_psi@";
+    stream << std::hex << this;
+    stream << " [pat version: ";
+    stream << std::dec << m_pat_version;
+    stream << ", programs: ";
+    stream << std::dec << m_programs.size();
+    stream << ", crc errors: ";
+    stream << std::dec << m_crc_errors;
+    stream << "]";
+
+    for (const auto& p : m_programs) {
+        stream << std::endl;
+        stream << "  program " << std::dec << p.first;
+        stream << " pmt pid: " << HEXDEC(p.second.pmt_pid);
+        stream << " version: " << std::dec << p.second.version;
+        for (const auto& es : p.second.streams) {
+            stream << std::endl;
+            stream << "    stream_type: " << HEXDEC(es.stream_type);
+            stream << " pid: " << HEXDEC(es.pid);
+        }
+    }
+
+    return stream.str();
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+void mpeg2ts_psi::assemble(uint16_t pid, const uint8_t* data, std::size_t count)
+{
+    section_buffer& sb = m_sections[pid];
+
+    sb.data.insert(sb.data.end(), data, data + count);
+
+    while (sb.started && (sb.data.size() >= 3)) {
+        if (0xff == sb.data[0]) {
+            /* stuffing bytes till the end of the ts packet */
+            sb.started = false;
+            sb.data.clear();
+            break;
+        }
+
+        const std::size_t size = 3 + (get_u16(&sb.data[1]) & 0x0fff);
+        if (size > MPEG2TS_PSI_MAX_SECTION_SIZE) {
+            sb.started = false;
+            sb.data.clear();
+            break;
+        }
+
+        if (sb.data.size() < size)
+            break;
+
+        /* handling the section may add/remove other section buffers */
+        const std::vector<uint8_t> section(sb.data.begin(), sb.data.begin() + size);
+        sb.data.erase(sb.data.begin(), sb.data.begin() + size);
+        if (sb.data.empty())
+            sb.started = false;
+
+        handle_section(pid, section.data(), section.size());
+    }
+}
+
+void mpeg2ts_psi::handle_section(uint16_t pid, const uint8_t* section, std::size_t size)
+{
+    if (size < MPEG2TS_PSI_SECTION_HEADER_SIZE + MPEG2TS_PSI_CRC32_SIZE)
+        return;
+
+    /* section_syntax_indicator */
+    if (!(section[1] & 0x80))
+        return;
+
+    if (mpeg2ts_psi_crc32(section, size) != 0) {
+        m_crc_errors++;
+        return;
+    }
+
+    /* current_next_indicator - table is not applicable yet */
+    if (!(section[5] & 0x01))
+        return;
+
+    if ((MPEG2TS_PSI_PAT_PID == pid) && (MPEG2TS_PSI_TABLE_ID_PAT == section[0]))
+        handle_pat(section, size - MPEG2TS_PSI_CRC32_SIZE);
+    else
+    if ((MPEG2TS_PSI_PAT_PID != pid) && (MPEG2TS_PSI_TABLE_ID_PMT == section[0]))
+        handle_pmt(pid, section, size - MPEG2TS_PSI_CRC32_SIZE);
+}
+
+void mpeg2ts_psi::handle_pat(const uint8_t* section, std::size_t size)
+{
+    const int version = (section[5] >> 1) & 0x1f;
+    const uint8_t section_number = section[6];
+    const uint8_t last_section_number = section[7];
+
+    if (version != m_pat_version) {
+        /* new table - all its sections have to be received before it is applied */
+        m_pat_version = version;
+        m_pat_sections.reset();
+        m_pat_programs.clear();
+    }
+    else
+    if (m_pat_sections.test(section_number))
+        return; /* repetition */
+
+    for (std::size_t n = MPEG2TS_PSI_SECTION_HEADER_SIZE; n + 4 <= size; n += 4) {
+        const uint16_t program_number = get_u16(section + n);
+        const uint16_t pmt_pid = get_u16(section + n + 2) & MPEG2TS_PID_MAX;
+
+        /* program_number 0 points to network information table */
+        if (program_number != 0)
+            m_pat_programs[program_number] = pmt_pid;
+    }
+
+    m_pat_sections.set(section_number);
+
+    for (unsigned int i = 0; i <= last_section_number; ++i)
+        if (!m_pat_sections.test(i))
+            return;
+
+    apply_pat();
+}
+
+void mpeg2ts_psi::handle_pmt(uint16_t pid, const uint8_t* section, std::size_t size)
+{
+    const uint16_t program_number = get_u16(section + 3);
+    const int version = (section[5] >> 1) & 0x1f;
+
+    auto it = m_programs.find(program_number);
+    if ((it == m_programs.end()) || (it->second.pmt_pid != pid))
+        return; /* program not announced in PAT (or carried by other pid) */
+
+    program& prog = it->second;
+    if (version == prog.version)
+        return; /* repetition */
+
+    /* PCR_PID (2), program_info_length (2) */
+    if (size < MPEG2TS_PSI_SECTION_HEADER_SIZE + 4)
+        return;
+
+    std::size_t n = MPEG2TS_PSI_SECTION_HEADER_SIZE + 4 + (get_u16(section + MPEG2TS_PSI_SECTION_HEADER_SIZE + 2) & 0x0fff);
+    std::vector<elementary_stream> streams;
+
+    while (n + 5 <= size) {
+        elementary_stream es;
+
+        es.stream_type = section[n];
+        es.pid = get_u16(section + n + 1) & MPEG2TS_PID_MAX;
+        streams.push_back(es);
+
+        n += 5 + (get_u16(section + n + 3) & 0x0fff);
+    }
+
+    const std::vector<elementary_stream> previous = prog.streams;
+
+    prog.version = version;
+    prog.streams = streams;
+
+    auto carries = [](const std::vector<elementary_stream>& v, uint16_t pid) {
+        return std::any_of(v.begin(), v.end(), [pid](const elementary_stream& es) {
+            return (MPEG2TS_STREAM_TYPE_H264 == es.stream_type) && (es.pid == pid);
+        });
+    };
+
+    for (const auto& es : previous)
+        if ((MPEG2TS_STREAM_TYPE_H264 == es.stream_type) && !carries(streams, es.pid) &&
+            !is_h264_stream_carried(es.pid, program_number))
+            m_function(mpeg2ts_psi_event_e::STREAM_REMOVED, program_number, es.pid);
+
+    for (const auto& es : streams)
+        if ((MPEG2TS_STREAM_TYPE_H264 == es.stream_type) && !carries(previous, es.pid) &&
+            !is_h264_stream_carried(es.pid, program_number))
+            m_function(mpeg2ts_psi_event_e::STREAM_ADDED, program_number, es.pid);
+}
+
+void mpeg2ts_psi::apply_pat()
+{
+    std::vector<uint16_t> removed;
+
+    for (const auto& p : m_programs) {
+        auto it = m_pat_programs.find(p.first);
+        if ((it == m_pat_programs.end()) || (it->second != p.second.pmt_pid))
+            removed.push_back(p.first);
+    }
+
+    for (const auto program_number : removed)
+        remove_program(program_number);
+
+    for (const auto& p : m_pat_programs) {
+        if (m_programs.find(p.first) != m_programs.end())
+            continue;
+
+        program prog;
+        prog.pmt_pid = p.second;
+        prog.version = -1;
+        m_programs[p.first] = prog;
+
+        m_psi_pids.set(p.second);
+    }
+}
+
+void mpeg2ts_psi::remove_program(uint16_t program_number)
+{
+    auto it = m_programs.find(program_number);
+    if (it == m_programs.end())
+        return;
+
+    const program prog = it->second;
+    m_programs.erase(it);
+
+    const bool pmt_pid_used = std::any_of(m_programs.begin(), m_programs.end(),
+        [&prog](const std::pair<const uint16_t, program>& p) { return p.second.pmt_pid == prog.pmt_pid; });
+
+    if (!pmt_pid_used && (prog.pmt_pid != MPEG2TS_PSI_PAT_PID)) {
+        m_psi_pids.reset(prog.pmt_pid);
+        m_sections.erase(prog.pmt_pid);
+    }
+
+    for (const auto& es : prog.streams)
+        if ((MPEG2TS_STREAM_TYPE_H264 == es.stream_type) && !is_h264_stream_carried(es.pid, program_number))
+            m_function(mpeg2ts_psi_event_e::STREAM_REMOVED, program_number, es.pid);
+}
+
+bool mpeg2ts_psi::is_h264_stream_carried(uint16_t pid, uint16_t except_program_number) const
+{
+    for (const auto& p : m_programs) {
+        if (p.first == except_program_number)
+            continue;
+        for (const auto& es : p.second.streams)
+            if ((MPEG2TS_STREAM_TYPE_H264 == es.stream_type) && (es.pid == pid))
+                return true;
+    }
+
+    return false;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
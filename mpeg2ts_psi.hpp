@@ -0,0 +1,212 @@
+/**
+ * @file mpeg2ts_psi.hpp
+ *
+ * Definition of MPEG2 transport stream program specific information tracker.
+ *
+ * Tracker reassembles PSI sections (which may span many ts packets,
+ * and more of which may be carried in one ts packet), checks their CRC32
+ * and follows Program Association Table and Program Map Tables
+ * (ISO/IEC 13818-1, 2.4.4) including their version changes.
+ * Every appearance and disappearance of an H.264 video elementary stream
+ * (stream_type 0x1B) is reported to the user.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _MPEG2TS_PSI_HPP_
+#define _MPEG2TS_PSI_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <bitset>
+#include <functional> /* for std::function */
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "mpeg2ts_pid.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define MPEG2TS_PSI_PAT_PID                 0x0000
+
+#define MPEG2TS_PSI_TABLE_ID_PAT            0x00
+#define MPEG2TS_PSI_TABLE_ID_PMT            0x02
+
+/* section_length of PAT and PMT shall not exceed 0x3FD */
+#define MPEG2TS_PSI_MAX_SECTION_SIZE        (3 + 0x3fd)
+
+#define MPEG2TS_STREAM_TYPE_H264            0x1b
+
+#define MPEG2TS_PSI_EVENTS \
+    MPEG2TS_PSI_EVENT(STREAM_ADDED) \
+    MPEG2TS_PSI_EVENT(STREAM_REMOVED) \
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+enum class mpeg2ts_psi_event_e : int32_t
+{
+#define MPEG2TS_PSI_EVENT(id) id,
+    MPEG2TS_PSI_EVENTS
+#undef MPEG2TS_PSI_EVENT
+};
+
+constexpr static inline const char* to_string(mpeg2ts_psi_event_e e)
+{
+    const char *str = "invalid 'mpeg2ts_psi_event_e' value";
+
+    switch (e) {
+#define MPEG2TS_PSI_EVENT(id) case mpeg2ts_psi_event_e::id: str = #id; break;
+            MPEG2TS_PSI_EVENTS
+#undef MPEG2TS_PSI_EVENT
+    }
+
+    return str;
+}
+
+class mpeg2ts_psi
+{
+public:
+    /**
+     * Function informed about H.264 elementary streams
+     * appearing in (or disappearing from) the programs.
+     */
+    typedef std::function<void(mpeg2ts_psi_event_e event, uint16_t program_number, uint16_t pid)> stream_function;
+
+    explicit mpeg2ts_psi(const stream_function& function);
+    ~mpeg2ts_psi();
+
+    mpeg2ts_psi(const mpeg2ts_psi&) = delete;
+    mpeg2ts_psi(mpeg2ts_psi&&) = delete;
+    mpeg2ts_psi& operator = (const mpeg2ts_psi&) = delete;
+    mpeg2ts_psi& operator = (mpeg2ts_psi&&) = delete;
+
+    /**
+     * Tells whether ts packets of given pid carry PAT or one of PMTs.
+     */
+    bool is_psi_pid(uint16_t pid) const
+    {
+        return m_psi_pids.test(pid & MPEG2TS_PID_MAX);
+    }
+
+    /**
+     * Consumes one ts packet carrying PAT or PMT (see is_psi_pid()).
+     */
+    void push(const uint8_t* tspacket);
+
+    /**
+     * Forgets all programs (without reporting removal of their streams).
+     */
+    void reset();
+
+    std::size_t get_crc_errors() const
+    {
+        return m_crc_errors;
+    }
+
+    std::string to_string() const;
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    struct section_buffer
+    {
+        bool started;
+        std::vector<uint8_t> data;
+    };
+
+    struct elementary_stream
+    {
+        uint8_t stream_type;
+        uint16_t pid;
+    };
+
+    struct program
+    {
+        uint16_t pmt_pid;
+        int version; /* of the PMT, -1 if not received yet */
+        std::vector<elementary_stream> streams;
+    };
+
+    void assemble(uint16_t pid, const uint8_t* data, std::size_t count);
+    void handle_section(uint16_t pid, const uint8_t* section, std::size_t size);
+    void handle_pat(const uint8_t* section, std::size_t size);
+    void handle_pmt(uint16_t pid, const uint8_t* section, std::size_t size);
+    void apply_pat();
+    void remove_program(uint16_t program_number);
+    bool is_h264_stream_carried(uint16_t pid, uint16_t except_program_number) const;
+
+    stream_function m_function;
+
+    std::bitset<MPEG2TS_PID_MAX + 1> m_psi_pids;
+    std::map<uint16_t, section_buffer> m_sections;
+
+    /* PAT being received (may consist of more sections) */
+    int m_pat_version;
+    std::bitset<256> m_pat_sections;
+    std::map<uint16_t, uint16_t> m_pat_programs; /* program_number -> program_map_PID */
+
+    std::map<uint16_t, program> m_programs;
+
+    std::size_t m_crc_errors;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+/**
+ * Calculates CRC32 as used by MPEG2 PSI sections
+ * (polynomial 0x04C11DB7, initial value 0xFFFFFFFF, no reflection).
+ * Calculated over a whole section (including its CRC_32 field) gives 0
+ * if the section is not corrupted.
+ */
+uint32_t mpeg2ts_psi_crc32(const uint8_t* data, std::size_t count);
+
+} /* end of namespace ymn */
+
+#endif /* _MPEG2TS_PSI_HPP_ */
@@ -0,0 +1,398 @@
+/**
+ * @file mpeg2ts_seeker.cpp
+ *
+ * Time based seeking in MPEG2 transport stream files.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <algorithm>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "mpeg2ts_seeker.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+/* parser works on the mapped file directly, its own buffer is not used */
+#define MPEG2TS_SEEKER_PARSER_BUFFER_SIZE   4096
+
+/* part of the file scanned by open() for PCRs, PTS and parameter sets */
+#define MPEG2TS_SEEKER_HEAD_SIZE            (8 * 1024 * 1024)
+
+/* part of the file scanned by one probe (PCRs are sent at least every 100 ms) */
+#define MPEG2TS_SEEKER_PROBE_SIZE           (2 * 1024 * 1024)
+
+/* part of the file scanned for the last PCR (doubled until one is found) */
+#define MPEG2TS_SEEKER_TAIL_SIZE            (64 * 1024)
+
+/* bisection stops when PCR is that close below the goal (27 MHz units, 0.5 s) */
+#define MPEG2TS_SEEKER_PCR_TOLERANCE        (27000000 / 2)
+
+/* PES packet is sent (at most) that long before it is presented (27 MHz units, 1 s) */
+#define MPEG2TS_SEEKER_PCR_MARGIN           27000000
+
+#define MPEG2TS_SEEKER_MAX_PROBES           32
+#define MPEG2TS_SEEKER_RESOLUTION           (256 * 1024)
+
+/* limit of the scan for a key frame (long GOPs of high bitrate streams) */
+#define MPEG2TS_SEEKER_MAX_SCAN_SIZE        (64 * 1024 * 1024)
+
+/* PTS wraps around after 33 bits */
+#define MPEG2TS_SEEKER_PTS_MASK             ((UINT64_C(1) << 33) - 1)
+
+/* PCR (33 bits base * 300 + extension) wraps around every 26.5 hours */
+#define MPEG2TS_SEEKER_PCR_WRAP             ((UINT64_C(1) << 33) * 300)
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+static uint32_t mpeg2ts_seeker_copy_parameter_set(const keyframe_index& from, uint32_t ps, keyframe_index& to);
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+mpeg2ts_seeker::mpeg2ts_seeker(const uint8_t* data, uint64_t size, uint16_t pid) :
+    m_data(data),
+    m_size(size),
+    m_pid(pid),
+    m_parser(MPEG2TS_SEEKER_PARSER_BUFFER_SIZE),
+    m_tspacket_size(0),
+    m_tspacket_rate(0),
+    m_pcr_pid(MPEG2TS_PID_INVALID),
+    m_first_pcr{0, 0},
+    m_last_pcr{0, 0},
+    m_first_pts(KEYFRAME_INDEX_NO_PTS),
+    m_head_index(),
+    m_probes(0),
+    m_scanned_bytes(0)
+{
+}
+
+mpeg2ts_seeker::~mpeg2ts_seeker()
+{
+}
+
+bool mpeg2ts_seeker::open()
+{
+    keyframe_indexer indexer(m_head_index);
+    bool pes_packet = false;
+    uint64_t end = 0;
+
+    scan(0, std::min<uint64_t>(m_size, MPEG2TS_SEEKER_HEAD_SIZE),
+        [&](const uint8_t* tspacket, uint64_t offset) {
+            const uint16_t pid = mpeg2ts_parser_get_pid(tspacket);
+
+            if (!m_pcr_pid.is_valid() && mpeg2ts_parser_has_pcr(tspacket)) {
+                m_pcr_pid = pid;
+                m_first_pcr = {offset, mpeg2ts_parser_get_pcr(tspacket)};
+            }
+
+            end = offset + m_tspacket_size;
+
+            if (pid == m_pid) {
+                const unsigned int payload_offset = mpeg2ts_parser_get_payload_offset(tspacket);
+                if (0 == payload_offset)
+                    return true;
+
+                const uint8_t* payload = tspacket + payload_offset;
+                std::size_t count = MPEG2TS_PARSER_PACKET_SIZE - payload_offset;
+
+                if (mpeg2ts_parser_get_payload_unit_start_indicator(tspacket)) {
+                    const std::size_t header_size = mpeg2ts_parser_get_pes_header_size(payload, count);
+                    uint64_t pts = KEYFRAME_INDEX_NO_PTS;
+
+                    pes_packet = (header_size > 0);
+                    if (pes_packet) {
+                        if (mpeg2ts_parser_get_pes_pts(payload, pts) && (KEYFRAME_INDEX_NO_PTS == m_first_pts))
+                            m_first_pts = pts;
+                        indexer.unit_start(offset, pts);
+                        payload += header_size;
+                        count -= header_size;
+                    }
+                }
+
+                if (pes_packet)
+                    indexer.feed(payload, count, 0);
+            }
+
+            /* parameter sets are sent with the first key frame at the latest */
+            return !m_pcr_pid.is_valid() || (KEYFRAME_INDEX_NO_PTS == m_first_pts) ||
+                (0 == m_parser.get_tspacket_rate()) || (m_head_index.keyframes.size() < 2);
+        });
+
+    indexer.finish(end);
+
+    m_tspacket_rate = m_parser.get_tspacket_rate();
+
+    if ((0 == m_tspacket_size) || !m_pcr_pid.is_valid() || (KEYFRAME_INDEX_NO_PTS == m_first_pts))
+        return false;
+
+    /* last PCR - going backwards from the end of the file until one is found */
+    m_last_pcr = m_first_pcr;
+    for (uint64_t size = MPEG2TS_SEEKER_TAIL_SIZE; ; size *= 2) {
+        const uint64_t offset = (m_size > size) ? m_size - size : 0;
+        pcr_sample sample;
+
+        if (find_pcr(offset, m_size - offset, true, sample)) {
+            if (sample.pcr > m_first_pcr.pcr)
+                m_last_pcr = sample;
+            break;
+        }
+
+        if (0 == offset)
+            break;
+    }
+
+    return true;
+}
+
+bool mpeg2ts_seeker::seek(uint64_t time, keyframe_index& index)
+{
+    pcr_sample lo = m_first_pcr;
+    pcr_sample hi = m_last_pcr;
+    uint64_t goal;
+    uint64_t guess;
+
+    m_probes = 0;
+
+    /* PES packet presented at given time is sent not earlier than margin before that time
+       (time origin is moved from the first PTS to the first PCR) */
+    goal = m_first_pcr.pcr + time * 300;
+    goal = (goal > m_first_pcr.pcr + MPEG2TS_SEEKER_PCR_MARGIN) ? goal - MPEG2TS_SEEKER_PCR_MARGIN : m_first_pcr.pcr;
+
+    /* first guess is based on the transport rate, next ones alternate
+       between interpolation and bisection of the remaining range */
+    if (m_tspacket_rate > 0)
+        guess = lo.offset + (goal - lo.pcr) * m_tspacket_rate / 27000000 * m_tspacket_size;
+    else
+        guess = lo.offset + (hi.offset - lo.offset) / 2;
+
+    /* beyond the last PCR - key frame can only be found at the very end */
+    if (goal >= hi.pcr)
+        lo = hi;
+
+    while ((goal > lo.pcr) && (goal < hi.pcr) &&
+           (goal - lo.pcr > MPEG2TS_SEEKER_PCR_TOLERANCE) &&
+           (hi.offset - lo.offset > MPEG2TS_SEEKER_RESOLUTION) &&
+           (m_probes < MPEG2TS_SEEKER_MAX_PROBES)) {
+        pcr_sample sample;
+
+        if ((guess <= lo.offset) || (guess >= hi.offset))
+            guess = lo.offset + (hi.offset - lo.offset) / 2;
+
+        m_probes++;
+
+        if (!find_pcr(guess, std::min<uint64_t>(hi.offset - guess, MPEG2TS_SEEKER_PROBE_SIZE), false, sample) ||
+            (sample.pcr < lo.pcr) || (sample.pcr > hi.pcr))
+            hi.offset = guess; /* no (usable) PCR up to the upper bound */
+        else
+        if (sample.pcr <= goal)
+            lo = sample;
+        else
+            hi = sample;
+
+        if (m_probes & 1)
+            guess = lo.offset + (hi.offset - lo.offset) / 2;
+        else
+            guess = lo.offset + static_cast<uint64_t>(
+                static_cast<double>(goal - lo.pcr) / (hi.pcr - lo.pcr) * (hi.offset - lo.offset));
+    }
+
+    /* the stream is scanned (not decoded) from the last PCR before the goal */
+    keyframe_index found;
+    keyframe_indexer indexer(found);
+    bool pes_packet = false;
+    uint64_t end = lo.offset;
+    bool complete = false;
+
+    scan(lo.offset, std::min<uint64_t>(m_size - lo.offset, MPEG2TS_SEEKER_MAX_SCAN_SIZE),
+        [&](const uint8_t* tspacket, uint64_t offset) {
+            end = offset + m_tspacket_size;
+
+            if (mpeg2ts_parser_get_pid(tspacket) != m_pid)
+                return true;
+
+            const unsigned int payload_offset = mpeg2ts_parser_get_payload_offset(tspacket);
+            if (0 == payload_offset)
+                return true;
+
+            const uint8_t* payload = tspacket + payload_offset;
+            std::size_t count = MPEG2TS_PARSER_PACKET_SIZE - payload_offset;
+
+            if (mpeg2ts_parser_get_payload_unit_start_indicator(tspacket)) {
+                const std::size_t header_size = mpeg2ts_parser_get_pes_header_size(payload, count);
+                uint64_t pts = KEYFRAME_INDEX_NO_PTS;
+
+                pes_packet = (header_size > 0);
+                if (pes_packet) {
+                    mpeg2ts_parser_get_pes_pts(payload, pts);
+                    indexer.unit_start(offset, pts);
+                    payload += header_size;
+                    count -= header_size;
+                }
+            }
+
+            if (pes_packet)
+                indexer.feed(payload, count, 0);
+
+            /* key frames presented too early are dropped, the right one
+               is complete when the next access unit begins */
+            while (!found.keyframes.empty()) {
+                const keyframe_index::keyframe& kf = found.keyframes.front();
+
+                if ((KEYFRAME_INDEX_NO_PTS != kf.pts) &&
+                    (((kf.pts - m_first_pts) & MPEG2TS_SEEKER_PTS_MASK) >= time))
+                    break;
+                if ((found.keyframes.size() < 2) && (0 == kf.size))
+                    break;
+                found.keyframes.erase(found.keyframes.begin());
+            }
+
+            complete = !found.keyframes.empty() && (found.keyframes.front().size > 0);
+
+            return !complete;
+        });
+
+    if (!complete) {
+        /* key frame may end with the end of the file */
+        indexer.finish(end);
+        while (!found.keyframes.empty() &&
+               ((KEYFRAME_INDEX_NO_PTS == found.keyframes.front().pts) ||
+                (((found.keyframes.front().pts - m_first_pts) & MPEG2TS_SEEKER_PTS_MASK) < time)))
+            found.keyframes.erase(found.keyframes.begin());
+        if (found.keyframes.empty() || (end < m_size))
+            return false;
+    }
+
+    keyframe_index::keyframe kf = found.keyframes.front();
+
+    /* parameter sets might have been sent at the beginning of the stream only */
+    if ((KEYFRAME_INDEX_NO_PARAMETER_SET == kf.sps) && !m_head_index.keyframes.empty()) {
+        kf.sps = mpeg2ts_seeker_copy_parameter_set(m_head_index, m_head_index.keyframes.front().sps, index);
+        kf.pps = mpeg2ts_seeker_copy_parameter_set(m_head_index, m_head_index.keyframes.front().pps, index);
+    }
+    else {
+        kf.sps = mpeg2ts_seeker_copy_parameter_set(found, kf.sps, index);
+        kf.pps = mpeg2ts_seeker_copy_parameter_set(found, kf.pps, index);
+    }
+
+    index.keyframes.push_back(kf);
+
+    return true;
+}
+
+void mpeg2ts_seeker::prepare_index(keyframe_index& index) const
+{
+    index.reset();
+    index.ts = true;
+    index.pid = m_pid;
+    index.tspacket_size = m_tspacket_size;
+    index.file_size = m_size;
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+void mpeg2ts_seeker::scan(uint64_t offset, uint64_t size, const std::function<bool(const uint8_t* tspacket, uint64_t offset)>& function)
+{
+    mpeg2ts_parser_status_e status;
+    bool more = true;
+
+    m_parser.reset();
+    m_parser.attach(m_data + offset, size);
+
+    do {
+        status = m_parser.parse();
+        if ((status == mpeg2ts_parser_status_e::SYNC_GAINED) && (0 == m_tspacket_size))
+            m_tspacket_size = m_parser.get_tspacket_size();
+        if (status != mpeg2ts_parser_status_e::SYNCHRONIZED)
+            continue;
+
+        const uint8_t* tspacket = m_parser.get_tspacket();
+        m_scanned_bytes += m_parser.get_tspacket_size();
+        more = function(tspacket, tspacket - m_data);
+    } while (more && (status != mpeg2ts_parser_status_e::NEED_BYTES));
+}
+
+bool mpeg2ts_seeker::find_pcr(uint64_t offset, uint64_t size, bool last, pcr_sample& sample)
+{
+    bool found = false;
+
+    scan(offset, size,
+        [&](const uint8_t* tspacket, uint64_t offset) {
+            if ((mpeg2ts_parser_get_pid(tspacket) == m_pcr_pid) && mpeg2ts_parser_has_pcr(tspacket)) {
+                sample = {offset, mpeg2ts_parser_get_pcr(tspacket)};
+                /* PCRs are counted from the first one, even if they wrapped around since then */
+                if (sample.pcr < m_first_pcr.pcr)
+                    sample.pcr += MPEG2TS_SEEKER_PCR_WRAP;
+                found = true;
+            }
+            return last || !found;
+        });
+
+    return found;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
+static uint32_t mpeg2ts_seeker_copy_parameter_set(const keyframe_index& from, uint32_t ps, keyframe_index& to)
+{
+    if (KEYFRAME_INDEX_NO_PARAMETER_SET == ps)
+        return ps;
+
+    const keyframe_index::parameter_set& parameter_set = from.parameter_sets[ps];
+
+    /* key frames found by consecutive seeks usually share their parameter sets */
+    for (std::size_t i = 0; i < to.parameter_sets.size(); ++i)
+        if (to.parameter_sets[i].nal_unit == parameter_set.nal_unit)
+            return i;
+
+    to.parameter_sets.push_back(parameter_set);
+
+    return to.parameter_sets.size() - 1;
+}
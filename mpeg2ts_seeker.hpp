@@ -0,0 +1,225 @@
+/**
+ * @file mpeg2ts_seeker.hpp
+ *
+ * Definition of time based seeking in MPEG2 transport stream files.
+ *
+ * Seeker finds key frames presented at given times without reading
+ * the whole file. Byte offset of the requested time is estimated from
+ * the transport rate (derived from PCRs), refined by bisection of PCRs
+ * sampled in the file and then the stream is scanned (not decoded)
+ * up to the first key frame with PTS not earlier than the requested time.
+ * Found key frames are put into keyframe_index, so they can be decoded
+ * the same way as key frames of a sidecar index.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _MPEG2TS_SEEKER_HPP_
+#define _MPEG2TS_SEEKER_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <functional> /* for std::function */
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "mpeg2ts_parser.hpp"
+#include "keyframe_index.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+/* times given to the seeker are expressed in 90 kHz units (as PTS) */
+#define MPEG2TS_SEEKER_CLOCK                90000
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+class mpeg2ts_seeker
+{
+public:
+    /**
+     * @param[in] data Transport stream file (e.g. memory mapped).
+     * @param[in] size Size of the file.
+     * @param[in] pid  Pid of ts packets carrying the video stream.
+     */
+    explicit mpeg2ts_seeker(const uint8_t* data, uint64_t size, uint16_t pid);
+    ~mpeg2ts_seeker();
+
+    mpeg2ts_seeker(const mpeg2ts_seeker&) = delete;
+    mpeg2ts_seeker(mpeg2ts_seeker&&) = delete;
+    mpeg2ts_seeker& operator = (const mpeg2ts_seeker&) = delete;
+    mpeg2ts_seeker& operator = (mpeg2ts_seeker&&) = delete;
+
+    /**
+     * Reads beginning and end of the file: synchronizes to ts packets,
+     * finds first PTS of the video stream, first and last PCR
+     * and transport rate.
+     *
+     * @return true on success, false if the file does not look like
+     *         transport stream carrying PCRs and the video stream.
+     */
+    bool open();
+
+    /**
+     * Finds the first key frame presented at or after given time
+     * and appends it (with parameter sets it depends on) to the index.
+     * Index shall describe the same file (see prepare_index()).
+     *
+     * @param[in]     time  Time counted from the first PTS of the video stream
+     *                      in MPEG2TS_SEEKER_CLOCK units.
+     * @param[in,out] index Index the key frame is appended to.
+     *
+     * @return true on success, false if there is no such key frame.
+     */
+    bool seek(uint64_t time, keyframe_index& index);
+
+    /**
+     * Fills in fields of an empty index describing the file.
+     */
+    void prepare_index(keyframe_index& index) const;
+
+    /**
+     * @return PTS of the first PES packet of the video stream (time origin).
+     */
+    uint64_t get_first_pts() const
+    {
+        return m_first_pts;
+    }
+
+    /**
+     * @return Time between the first and the last PCR in MPEG2TS_SEEKER_CLOCK units.
+     */
+    uint64_t get_duration() const
+    {
+        return (m_last_pcr.pcr - m_first_pcr.pcr) / 300;
+    }
+
+    /**
+     * @return Number of PCR probes made by recent seek().
+     */
+    std::size_t get_probes() const
+    {
+        return m_probes;
+    }
+
+    /**
+     * @return Number of bytes scanned so far (by open() and all seek() calls).
+     */
+    uint64_t get_scanned_bytes() const
+    {
+        return m_scanned_bytes;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "mpeg2ts_seeker@";
+        stream << std::hex << this;
+        stream << " [pid: ";
+        stream << std::dec << m_pid;
+        stream << ", tspacket size: ";
+        stream << std::dec << m_tspacket_size;
+        stream << ", pcr pid: ";
+        stream << std::dec << m_pcr_pid;
+        stream << ", first pcr: ";
+        stream << std::dec << m_first_pcr.pcr;
+        stream << ", last pcr: ";
+        stream << std::dec << m_last_pcr.pcr;
+        stream << ", first pts: ";
+        stream << std::dec << m_first_pts;
+        stream << ", tspacket rate: ";
+        stream << std::dec << m_tspacket_rate;
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    /* PCR (27 MHz) found in ts packet at given file offset */
+    struct pcr_sample
+    {
+        uint64_t offset;
+        uint64_t pcr;
+    };
+
+    /**
+     * Parses ts packets of the given part of the file.
+     * Function is called for every ts packet (with its file offset)
+     * until it returns false.
+     */
+    void scan(uint64_t offset, uint64_t size, const std::function<bool(const uint8_t* tspacket, uint64_t offset)>& function);
+
+    bool find_pcr(uint64_t offset, uint64_t size, bool last, pcr_sample& sample);
+
+    const uint8_t* m_data;
+    uint64_t m_size;
+    uint16_t m_pid;
+
+    mpeg2ts_parser m_parser;
+    std::size_t m_tspacket_size;
+    std::size_t m_tspacket_rate;
+
+    mpeg2ts_pid m_pcr_pid;
+    pcr_sample m_first_pcr;
+    pcr_sample m_last_pcr;
+    uint64_t m_first_pts;
+
+    /* parameter sets sent at the beginning of the stream only */
+    keyframe_index m_head_index;
+
+    std::size_t m_probes;
+    uint64_t m_scanned_bytes;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _MPEG2TS_SEEKER_HPP_ */
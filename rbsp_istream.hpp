@@ -0,0 +1,310 @@
+/**
+ * @file rbsp_istream.hpp
+ *
+ * Definition of RBSP (raw byte sequence payload) input bit stream class.
+ *
+ * It reads bits of the RBSP directly from bytes of a NAL unit,
+ * skipping emulation_prevention_three_bytes (0x03 following 0x0000)
+ * on the fly, so that the NAL unit does not have to be copied
+ * (converted to RBSP) before it is read.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _RBSP_ISTREAM_HPP_
+#define _RBSP_ISTREAM_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+
+#include <cassert>
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "istream.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define RBSP_ISTREAM_EMULATION_PREVENTION_BYTE 0x03
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+class rbsp_istream
+{
+public:
+    /**
+     * @param[in] buffer     Pointer to the NAL unit bytes to be read.
+     * @param[in] size       Number of NAL unit bytes in the buffer.
+     * @param[in] zero_bytes Number of 0x00 bytes (up to 2) directly preceding
+     *                       the buffer in the NAL unit, so that emulation
+     *                       prevention bytes at the very beginning are recognized.
+     */
+    explicit rbsp_istream(const uint8_t* buffer = nullptr, std::size_t size = 0, uint32_t zero_bytes = 0) :
+        m_buffer(buffer),
+        m_size(size),
+        m_byte_position(0),
+        m_bit_position(0),
+        m_zero_bytes(zero_bytes),
+        m_emulation_prevention_bytes(0),
+        m_status(ISTREAM_STATUS_OK)
+    {
+        skip_emulation_prevention_byte();
+    }
+
+    ~rbsp_istream()
+    {
+    }
+
+    rbsp_istream(const rbsp_istream&) = default;
+    rbsp_istream& operator = (const rbsp_istream&) = default;
+
+    bool is_valid() const
+    {
+        return m_buffer != nullptr;
+    }
+
+    uint32_t status() const
+    {
+        return m_status;
+    }
+
+    /**
+     * Reads subsequent 'number_of_bits' bits of the RBSP from the current
+     * stream position and interprets them as uint32_t value.
+     *
+     * If the read operation would cause that stream position is moved beyond
+     * the stream boundaries, then this function fails (returns false)
+     * and stream position is not altered.
+     *
+     * @param[in] number_of_bits Number of bits to be read.
+     * @param[out] value 'uint32_t' representation of retrieved bit pattern.
+     *
+     * @return true on success, false on failure.
+     */
+    bool read_bits(uint32_t number_of_bits, uint32_t& value)
+    {
+        assert(number_of_bits <= 32);
+
+        /* fast path, all the bits are in the current byte */
+        if ((m_bit_position + number_of_bits < BITS_PER_BYTE) && (m_byte_position < m_size)) {
+            m_bit_position += number_of_bits;
+            value = (m_buffer[m_byte_position] >> (BITS_PER_BYTE - m_bit_position)) & ((1U << number_of_bits) - 1);
+            return true;
+        }
+
+        const rbsp_istream saved = *this;
+
+        uint32_t v = 0;
+        uint32_t bits_remaining = number_of_bits;
+        uint32_t bits_to_read;
+
+        while (bits_remaining > 0) {
+            if (m_byte_position >= m_size) {
+                *this = saved;
+                m_status |= ISTREAM_STATUS_EOS_REACHED;
+                return false;
+            }
+
+            /* there is more bits to be read than bits left in current byte */
+            if ((m_bit_position + bits_remaining) >= BITS_PER_BYTE) {
+                bits_to_read = BITS_PER_BYTE - m_bit_position;
+
+                v <<= bits_to_read;
+                v |= m_buffer[m_byte_position] & ((1U << bits_to_read) - 1);
+
+                next_byte();
+            }
+            else {
+                bits_to_read = bits_remaining;
+
+                v <<= bits_to_read;
+                m_bit_position += bits_to_read;
+                v |= (m_buffer[m_byte_position] >> (BITS_PER_BYTE - m_bit_position)) & ((1U << bits_to_read) - 1);
+            }
+
+            bits_remaining -= bits_to_read;
+        }
+
+        value = v;
+        return true;
+    }
+
+    /**
+     * Reads unsigned Exp-Golomb code (see istream::read_exp_golomb_u()).
+     *
+     * @param[out] value Decoded value.
+     *
+     * @return true on success, false on failure (stream position is not altered).
+     */
+    bool read_exp_golomb_u(uint32_t& value)
+    {
+        const rbsp_istream saved = *this;
+        uint32_t leading_zero_bits = 0;
+        uint32_t v;
+
+        while (read_bits(1, v) && (0 == v))
+            leading_zero_bits++;
+
+        if ((m_status & ISTREAM_STATUS_EOS_REACHED) || (leading_zero_bits > 31) ||
+            !read_bits(leading_zero_bits, v)) {
+            *this = saved;
+            m_status |= ISTREAM_STATUS_EOS_REACHED;
+            return false;
+        }
+
+        value = v + (1U << leading_zero_bits) - 1;
+        return true;
+    }
+
+    /**
+     * Skips given number of RBSP bits.
+     *
+     * @return true on success, false if the end of the stream was reached.
+     */
+    bool skip_bits(std::size_t number_of_bits)
+    {
+        uint32_t v;
+
+        for (; number_of_bits >= 32; number_of_bits -= 32)
+            if (!read_bits(32, v))
+                return false;
+
+        return read_bits(number_of_bits, v);
+    }
+
+    /**
+     * Gets offset (in NAL unit bytes, emulation prevention bytes included)
+     * of the byte where subsequent read operation will start from.
+     */
+    std::size_t tell() const
+    {
+        return m_byte_position;
+    }
+
+    std::size_t tell_bits() const
+    {
+        return m_bit_position;
+    }
+
+    /**
+     * Gets number of emulation prevention bytes skipped so far.
+     */
+    std::size_t get_emulation_prevention_bytes() const
+    {
+        return m_emulation_prevention_bytes;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "rbsp_istream@";
+        stream << std::hex << this;
+        stream << " [";
+        stream << "size: ";
+        stream << std::dec << m_size;
+        stream << ", position: ";
+        stream << std::dec << m_byte_position << ":" << m_bit_position;
+        stream << ", emulation prevention bytes: ";
+        stream << std::dec << m_emulation_prevention_bytes;
+        stream << ", status: ";
+        stream << istream_status_to_string(m_status);
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    void next_byte()
+    {
+        if (0x00 == m_buffer[m_byte_position])
+            m_zero_bytes++;
+        else
+            m_zero_bytes = 0;
+
+        m_byte_position++;
+        m_bit_position = 0;
+
+        skip_emulation_prevention_byte();
+    }
+
+    /* within the NAL unit 0x000003 is always followed by a byte of RBSP,
+       the only exception is cabac_zero_word at the end of the NAL unit */
+    void skip_emulation_prevention_byte()
+    {
+        if ((m_zero_bytes >= 2) && (m_byte_position < m_size) &&
+            (RBSP_ISTREAM_EMULATION_PREVENTION_BYTE == m_buffer[m_byte_position])) {
+            m_byte_position++;
+            m_zero_bytes = 0;
+            m_emulation_prevention_bytes++;
+        }
+    }
+
+    /** NAL unit bytes m_buffer[0] ... m_buffer[m_size - 1] */
+    const uint8_t* m_buffer;
+    std::size_t m_size;
+
+    /** Current stream position (never points to emulation prevention byte). */
+    std::size_t m_byte_position;
+    uint32_t m_bit_position;
+
+    /** Number of 0x00 bytes preceding the current byte. */
+    uint32_t m_zero_bytes;
+
+    std::size_t m_emulation_prevention_bytes;
+
+    /** Stream's status */
+    uint32_t m_status;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _RBSP_ISTREAM_HPP_ */
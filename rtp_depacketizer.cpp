@@ -0,0 +1,313 @@
+/**
+ * @file rtp_depacketizer.cpp
+ *
+ * RTP depacketizer (reorder buffer, RFC 6184 and RFC 2250 payloads).
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "rtp_depacketizer.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+/* RFC 6184, 5.4 NAL unit types used by payload structures */
+#define RTP_H264_STAP_A                 24
+#define RTP_H264_FU_A                   28
+
+#define RTP_H264_FU_START             0x80
+#define RTP_H264_FU_END               0x40
+
+#define RTP_SEQUENCE_NUMBERS          65536
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+/* slots are indexed by sequence_number % depth, which stays collision free
+   across sequence number wrap only if depth divides RTP_SEQUENCE_NUMBERS */
+static inline std::size_t rtp_depacketizer_depth(std::size_t depth)
+{
+    std::size_t d = 2;
+
+    while ((d < depth) && (d < RTP_SEQUENCE_NUMBERS))
+        d <<= 1;
+
+    return d;
+}
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+rtp_depacketizer::rtp_depacketizer(rtp_payload_format_e format, const data_function& function, std::size_t depth) :
+    m_format(format),
+    m_function(function),
+    m_slots(rtp_depacketizer_depth(depth)),
+    m_buffered(0),
+    m_synchronized(false),
+    m_started(false),
+    m_next_sequence_number(0),
+    m_highest_sequence_number(0),
+    m_ssrc(0),
+    m_fu(),
+    m_fu_valid(false),
+    m_received(0),
+    m_lost(0),
+    m_late(0),
+    m_duplicated(0)
+{
+    reset();
+}
+
+rtp_depacketizer::~rtp_depacketizer()
+{
+}
+
+void rtp_depacketizer::push(const rtp_header& header, const uint8_t* payload, std::size_t size)
+{
+    const std::size_t depth = m_slots.size();
+    int16_t distance;
+
+    m_received++;
+
+    if (m_synchronized && (header.ssrc != m_ssrc)) {
+        /* new source - whatever is buffered belongs to the previous one */
+        flush();
+        m_synchronized = false;
+    }
+
+    if (!m_synchronized) {
+        m_synchronized = true;
+        m_started = false;
+        m_ssrc = header.ssrc;
+        m_next_sequence_number = header.sequence_number;
+        m_highest_sequence_number = header.sequence_number;
+    }
+
+    distance = static_cast<int16_t>(header.sequence_number - m_next_sequence_number);
+    if (distance < 0) {
+        if (m_started || (static_cast<uint16_t>(m_highest_sequence_number - header.sequence_number) >= depth)) {
+            /* already delivered or already declared as lost */
+            m_late++;
+            return;
+        }
+        /* nothing delivered yet - packet preceding the first received one */
+        m_next_sequence_number = header.sequence_number;
+        distance = 0;
+    }
+
+    if (static_cast<std::size_t>(distance) >= depth) {
+        /* jump too big to be covered by reordering - resynchronize */
+        flush();
+        m_lost += static_cast<uint16_t>(header.sequence_number - m_next_sequence_number);
+        m_next_sequence_number = header.sequence_number;
+        m_highest_sequence_number = header.sequence_number;
+        m_fu_valid = false;
+    }
+
+    slot& s = m_slots[header.sequence_number % depth];
+    if (s.used) {
+        m_duplicated++;
+        return;
+    }
+
+    s.used = true;
+    s.sequence_number = header.sequence_number;
+    s.payload.assign(payload, payload + size);
+    m_buffered++;
+
+    if (static_cast<int16_t>(header.sequence_number - m_highest_sequence_number) > 0)
+        m_highest_sequence_number = header.sequence_number;
+
+    if (!m_started) {
+        /* give packets sent before the first received one a chance to arrive */
+        if (m_buffered < depth / 8)
+            return;
+        m_started = true;
+    }
+
+    drain();
+
+    /* do not wait forever for a packet which is most likely lost */
+    while (m_buffered > depth / 2) {
+        skip();
+        drain();
+    }
+}
+
+void rtp_depacketizer::flush()
+{
+    while (m_buffered > 0) {
+        skip();
+        drain();
+    }
+
+    m_started = true;
+    m_fu_valid = false;
+}
+
+void rtp_depacketizer::reset()
+{
+    for (auto& s : m_slots) {
+        s.used = false;
+        s.sequence_number = 0;
+        s.payload.clear();
+    }
+
+    m_buffered = 0;
+    m_synchronized = false;
+    m_started = false;
+    m_next_sequence_number = 0;
+    m_highest_sequence_number = 0;
+    m_ssrc = 0;
+    m_fu.clear();
+    m_fu_valid = false;
+    m_received = 0;
+    m_lost = 0;
+    m_late = 0;
+    m_duplicated = 0;
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+void rtp_depacketizer::skip()
+{
+    const std::size_t depth = m_slots.size();
+
+    while (!m_slots[m_next_sequence_number % depth].used) {
+        m_lost++;
+        m_next_sequence_number++;
+        /* fragmented NAL unit cannot be completed any more */
+        m_fu_valid = false;
+    }
+}
+
+void rtp_depacketizer::drain()
+{
+    const std::size_t depth = m_slots.size();
+
+    for (;;) {
+        slot& s = m_slots[m_next_sequence_number % depth];
+        if (!s.used || (s.sequence_number != m_next_sequence_number))
+            break;
+
+        deliver(s.payload.data(), s.payload.size());
+
+        s.used = false;
+        m_buffered--;
+        m_next_sequence_number++;
+    }
+}
+
+void rtp_depacketizer::deliver(const uint8_t* payload, std::size_t size)
+{
+    if (0 == size)
+        return;
+
+    switch (m_format) {
+        case rtp_payload_format_e::H264:
+            deliver_h264(payload, size);
+            break;
+
+        case rtp_payload_format_e::MP2T:
+            m_function(payload, size);
+            break;
+    }
+}
+
+void rtp_depacketizer::deliver_h264(const uint8_t* payload, std::size_t size)
+{
+    const uint8_t type = payload[0] & 0x1f;
+
+    if ((type >= 1) && (type <= 23)) {
+        /* single NAL unit packet */
+        m_fu_valid = false;
+        m_function(payload, size);
+    }
+    else
+    if (RTP_H264_STAP_A == type) {
+        std::size_t i = 1;
+        m_fu_valid = false;
+        while (i + 2 <= size) {
+            std::size_t nalu_size = (payload[i] << 8) | payload[i + 1];
+            i += 2;
+            if ((0 == nalu_size) || (i + nalu_size > size))
+                break;
+            m_function(payload + i, nalu_size);
+            i += nalu_size;
+        }
+    }
+    else
+    if (RTP_H264_FU_A == type) {
+        if (size < 2)
+            return;
+
+        if (payload[1] & RTP_H264_FU_START) {
+            /* reconstruct NAL unit header from FU indicator and FU header */
+            m_fu.assign(1, (payload[0] & 0xe0) | (payload[1] & 0x1f));
+            m_fu_valid = true;
+        }
+
+        if (!m_fu_valid)
+            return;
+
+        m_fu.insert(m_fu.end(), payload + 2, payload + size);
+
+        if (payload[1] & RTP_H264_FU_END) {
+            m_fu_valid = false;
+            m_function(m_fu.data(), m_fu.size());
+        }
+    }
+    else {
+        /* STAP-B, MTAP16, MTAP24 and FU-B are for interleaved mode only */
+    }
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
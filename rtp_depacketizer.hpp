@@ -0,0 +1,219 @@
+/**
+ * @file rtp_depacketizer.hpp
+ *
+ * Definition of RTP depacketizer.
+ *
+ * Depacketizer puts received RTP packets back in sequence number order
+ * (reorder/jitter buffer) and reconstructs the transported data, which is:
+ * - for H.264 (RFC 6184 "RTP Payload Format for H.264 Video",
+ *   non-interleaved mode) complete NAL units
+ *   (single NAL unit packets, STAP-A aggregates and FU-A fragments),
+ * - for MPEG2 TS (RFC 2250 "RTP Payload Format for MPEG1/MPEG2 Video")
+ *   sets of transport stream packets.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _RTP_DEPACKETIZER_HPP_
+#define _RTP_DEPACKETIZER_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+#include <vector>
+#include <functional> /* for std::function */
+
+#include <cstdint>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "rtp_parser.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define RTP_DEPACKETIZER_DEPTH          64
+
+#define RTP_PAYLOAD_FORMATS \
+    RTP_PAYLOAD_FORMAT(H264) \
+    RTP_PAYLOAD_FORMAT(MP2T) \
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+enum class rtp_payload_format_e : int32_t
+{
+#define RTP_PAYLOAD_FORMAT(id) id,
+    RTP_PAYLOAD_FORMATS
+#undef RTP_PAYLOAD_FORMAT
+};
+
+constexpr static inline const char* to_string(rtp_payload_format_e e)
+{
+    const char *str = "invalid 'rtp_payload_format_e' value";
+
+    switch (e) {
+#define RTP_PAYLOAD_FORMAT(id) case rtp_payload_format_e::id: str = #id; break;
+            RTP_PAYLOAD_FORMATS
+#undef RTP_PAYLOAD_FORMAT
+    }
+
+    return str;
+}
+
+class rtp_depacketizer
+{
+public:
+    /**
+     * Function receiving depacketized data: one complete NAL unit
+     * (without start code prefix) for H264, set of ts packets for MP2T.
+     */
+    typedef std::function<void(const uint8_t* data, std::size_t count)> data_function;
+
+    /**
+     * @param[in] format   Payload format carried by RTP packets.
+     * @param[in] function Receiver of depacketized data.
+     * @param[in] depth    Number of packets which can be held in reorder buffer
+     *                     while waiting for a missing one (rounded up
+     *                     to a power of two, 2 ... 65536).
+     */
+    explicit rtp_depacketizer(rtp_payload_format_e format, const data_function& function,
+        std::size_t depth = RTP_DEPACKETIZER_DEPTH);
+    ~rtp_depacketizer();
+
+    rtp_depacketizer(const rtp_depacketizer&) = delete;
+    rtp_depacketizer(rtp_depacketizer&&) = delete;
+    rtp_depacketizer& operator = (const rtp_depacketizer&) = delete;
+    rtp_depacketizer& operator = (rtp_depacketizer&&) = delete;
+
+    /**
+     * Puts received packet into reorder buffer and delivers all packets
+     * which are in sequence.
+     */
+    void push(const rtp_header& header, const uint8_t* payload, std::size_t size);
+
+    /**
+     * Delivers all buffered packets (treating holes as lost),
+     * e.g. at the end of the stream.
+     */
+    void flush();
+
+    void reset();
+
+    std::size_t get_lost() const
+    {
+        return m_lost;
+    }
+
+    std::size_t get_late() const
+    {
+        return m_late;
+    }
+
+    std::size_t get_duplicated() const
+    {
+        return m_duplicated;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "rtp_depacketizer@";
+        stream << std::hex << this;
+        stream << " [format: ";
+        stream << ymn::to_string(m_format);
+        stream << ", received: ";
+        stream << std::dec << m_received;
+        stream << ", lost: ";
+        stream << std::dec << m_lost;
+        stream << ", late: ";
+        stream << std::dec << m_late;
+        stream << ", duplicated: ";
+        stream << std::dec << m_duplicated;
+        stream << "]";
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+private:
+    struct slot
+    {
+        bool used;
+        uint16_t sequence_number;
+        std::vector<uint8_t> payload;
+    };
+
+    void skip();
+    void drain();
+    void deliver(const uint8_t* payload, std::size_t size);
+    void deliver_h264(const uint8_t* payload, std::size_t size);
+
+    rtp_payload_format_e m_format;
+    data_function m_function;
+
+    std::vector<slot> m_slots;
+    std::size_t m_buffered;
+    bool m_synchronized;
+    bool m_started;
+    uint16_t m_next_sequence_number;
+    uint16_t m_highest_sequence_number;
+    uint32_t m_ssrc;
+
+    /* FU-A reassembly buffer */
+    std::vector<uint8_t> m_fu;
+    bool m_fu_valid;
+
+    std::size_t m_received;
+    std::size_t m_lost;
+    std::size_t m_late;
+    std::size_t m_duplicated;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+#endif /* _RTP_DEPACKETIZER_HPP_ */
@@ -0,0 +1,151 @@
+/**
+ * @file rtp_parser.cpp
+ *
+ * RTP (RFC 3550) packet parser.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "rtp_parser.hpp"
+
+/*===========================================================================*\
+ * 'using namespace' section
+\*===========================================================================*/
+using namespace ymn;
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+namespace
+{
+
+} // end of anonymous namespace
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+bool ymn::rtp_parse_packet(const uint8_t* packet, std::size_t size,
+    rtp_header& header, const uint8_t*& payload, std::size_t& payload_size)
+{
+    const uint8_t* p = packet;
+    std::size_t header_size;
+    std::size_t padding_size;
+
+    if (size < RTP_FIXED_HEADER_SIZE)
+        return false;
+
+    header.version         = (p[0] >> 6) & 0x03;
+    header.padding         = (p[0] >> 5) & 0x01;
+    header.extension       = (p[0] >> 4) & 0x01;
+    header.csrc_count      = (p[0] >> 0) & 0x0f;
+    header.marker          = (p[1] >> 7) & 0x01;
+    header.payload_type    = (p[1] >> 0) & 0x7f;
+    header.sequence_number = (p[2] << 8) | p[3];
+    header.timestamp       = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+    header.ssrc            = (p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+
+    if (header.version != RTP_VERSION)
+        return false;
+
+    header_size = RTP_FIXED_HEADER_SIZE + 4 * header.csrc_count;
+    if (size < header_size)
+        return false;
+
+    if (header.extension) {
+        /* 5.3.1 RTP Header Extension: 16 bit profile specific identifier,
+           16 bit length (in 32 bit words) of the extension */
+        if (size < header_size + 4)
+            return false;
+        header_size += 4 + 4 * ((p[header_size + 2] << 8) | p[header_size + 3]);
+        if (size < header_size)
+            return false;
+    }
+
+    padding_size = 0;
+    if (header.padding) {
+        /* last octet of the padding contains a count of how many padding octets should be ignored */
+        padding_size = p[size - 1];
+        if ((0 == padding_size) || (size < header_size + padding_size))
+            return false;
+    }
+
+    payload = p + header_size;
+    payload_size = size - header_size - padding_size;
+
+    return true;
+}
+
+rtp_parser_status_e rtp_parser::parse()
+{
+    std::size_t available;
+    std::size_t packet_size;
+    const uint8_t* p;
+
+    available = m_flatbuffer.read_available();
+    if (available < RTP_FRAMING_HEADER_SIZE)
+        return rtp_parser_status_e::NEED_BYTES;
+
+    p = m_flatbuffer.read_ptr();
+    packet_size = (p[0] << 8) | p[1];
+
+    if (available < RTP_FRAMING_HEADER_SIZE + packet_size)
+        return rtp_parser_status_e::NEED_BYTES;
+
+    m_flatbuffer.consume(RTP_FRAMING_HEADER_SIZE + packet_size);
+
+    if (!rtp_parse_packet(p + RTP_FRAMING_HEADER_SIZE, packet_size, m_header, m_payload, m_payload_size)) {
+        m_payload = nullptr;
+        m_payload_size = 0;
+        return rtp_parser_status_e::PACKET_CORRUPTED;
+    }
+
+    return rtp_parser_status_e::PACKET_PARSED;
+}
+
+/*===========================================================================*\
+ * protected function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * private function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
@@ -0,0 +1,237 @@
+/**
+ * @file rtp_parser.hpp
+ *
+ * Definition of RTP (RFC 3550) packet parser.
+ *
+ * RTP packets are expected to be framed as defined in RFC 4571
+ * "Framing Real-time Transport Protocol (RTP) and RTP Control Protocol (RTCP)
+ * Packets over Connection-Oriented Transport", that is each packet is preceded
+ * by 16 bit (big endian) length field. This is also how recorded RTP sessions
+ * are stored in a file.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _RTP_PARSER_HPP_
+#define _RTP_PARSER_HPP_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <string>
+#include <sstream>
+
+#include <cstdint>
+
+#if defined(DEBUG_PARSERS)
+#include <iostream>
+#endif
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "ioutilities.hpp"
+#include "base_parser.hpp"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define RTP_VERSION                      2
+#define RTP_FIXED_HEADER_SIZE           12
+#define RTP_FRAMING_HEADER_SIZE          2
+#define RTP_MAX_PACKET_SIZE          65535
+
+#define RTP_PARSER_STATUSES \
+    RTP_PARSER_STATUS(NEED_BYTES) \
+    RTP_PARSER_STATUS(PACKET_PARSED) \
+    RTP_PARSER_STATUS(PACKET_CORRUPTED) \
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+namespace ymn
+{
+
+enum class rtp_parser_status_e : int32_t
+{
+#define RTP_PARSER_STATUS(id) id,
+    RTP_PARSER_STATUSES
+#undef RTP_PARSER_STATUS
+};
+
+constexpr static inline const char* to_string(rtp_parser_status_e e)
+{
+    const char *str = "invalid 'rtp_parser_status_e' value";
+
+    switch (e) {
+#define RTP_PARSER_STATUS(id) case rtp_parser_status_e::id: str = #id; break;
+            RTP_PARSER_STATUSES
+#undef RTP_PARSER_STATUS
+    }
+
+    return str;
+}
+
+/* RFC 3550, 5.1 RTP Fixed Header Fields */
+struct rtp_header
+{
+    uint32_t version;
+    uint32_t padding;
+    uint32_t extension;
+    uint32_t csrc_count;
+    uint32_t marker;
+    uint32_t payload_type;
+    uint16_t sequence_number;
+    uint32_t timestamp;
+    uint32_t ssrc;
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << "rtp header:" << std::endl;
+        stream << P1(version);
+        stream << P1(padding);
+        stream << P1(extension);
+        stream << P1(csrc_count);
+        stream << P1(marker);
+        stream << P1(payload_type);
+        stream << P1(sequence_number);
+        stream << P1(timestamp);
+        stream << P1(ssrc);
+
+        return stream.str();
+    }
+};
+
+class rtp_parser : public base_parser<uint8_t>
+{
+public:
+    explicit rtp_parser(std::size_t capacity) :
+        base_parser<uint8_t>(capacity),
+        m_header(),
+        m_payload(nullptr),
+        m_payload_size(0)
+    {
+#if defined(DEBUG_PARSERS)
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+        std::cout << to_string() << std::endl;
+#endif
+    }
+
+    virtual ~rtp_parser()
+    {
+#if defined(DEBUG_PARSERS)
+        std::cout << __PRETTY_FUNCTION__ << std::endl;
+#endif
+    }
+
+    rtp_parser(const rtp_parser&) = delete;
+    rtp_parser(rtp_parser&&) = delete;
+    rtp_parser& operator = (const rtp_parser&) = delete;
+    rtp_parser& operator = (rtp_parser&&) = delete;
+
+    void reset()
+    {
+        base_parser::reset();
+        m_payload = nullptr;
+        m_payload_size = 0;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream stream;
+
+        stream << base_parser::to_string();
+        stream << std::endl;
+        stream << "rtp_parser@";
+        stream << std::hex << this;
+
+        return stream.str();
+    }
+
+    operator std::string () const
+    {
+        return to_string();
+    }
+
+    /**
+     * Extracts next (RFC 4571 framed) RTP packet from parser's flatbuffer.
+     *
+     * When PACKET_PARSED is returned, get_header() and get_payload()
+     * give access to the packet. They stay valid until next write().
+     */
+    rtp_parser_status_e parse();
+
+    const rtp_header& get_header() const
+    {
+        return m_header;
+    }
+
+    const uint8_t* get_payload() const
+    {
+        return m_payload;
+    }
+
+    std::size_t get_payload_size() const
+    {
+        return m_payload_size;
+    }
+
+private:
+    rtp_header m_header;
+    const uint8_t* m_payload;
+    std::size_t m_payload_size;
+};
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * global object declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+} /* end of namespace ymn */
+
+/*===========================================================================*\
+ * function forward declarations
+\*===========================================================================*/
+namespace ymn
+{
+
+/**
+ * Parses RTP fixed header (together with CSRC list, header extension
+ * and padding) and locates the payload of the packet.
+ *
+ * @param[in]  packet       Pointer to the first byte of RTP packet.
+ * @param[in]  size         Size of the RTP packet.
+ * @param[out] header       Parsed fixed header.
+ * @param[out] payload      Pointer to the first byte of the payload.
+ * @param[out] payload_size Size of the payload.
+ *
+ * @return true on success, false if packet is malformed.
+ */
+bool rtp_parse_packet(const uint8_t* packet, std::size_t size,
+    rtp_header& header, const uint8_t*& payload, std::size_t& payload_size);
+
+} /* end of namespace ymn */
+
+#endif /* _RTP_PARSER_HPP_ */
@@ -62,9 +62,13 @@ struct slice_data : public h264_structure
 
     std::string to_string() const override;
 
+    /* NAL unit bytes (emulation prevention bytes included) following the slice header,
+       valid until next NAL unit is parsed */
     const uint8_t* data;
     size_t size;
     size_t bit_pos;
+    /* number of 0x00 bytes (up to 2) directly preceding data (see rbsp_istream) */
+    uint32_t zero_bytes;
 };
 
 inline std::string slice_data::to_string() const
@@ -75,6 +79,7 @@ inline std::string slice_data::to_string() const
 
     stream << P1(size);
     stream << P1(bit_pos);
+    stream << P1(zero_bytes);
 
     return stream.str();
 }